@@ -49,4 +49,37 @@ namespace Kernel {
         Register sepc;    //                 (0x100)
         Register sstatus; //                 (0x108)
     };
+
+    // What a context switch inside of the kernel (yield) saves, that is only the registers that a function call has to preserve, the rest of the registers of the thread are in its Context.
+    struct SwitchContext {
+                          // RegisterName    Offset (in this SwitchContext struct)
+        Register ra;      // x1              (0x00)
+        Register sp;      // x2              (0x08)
+
+        Register s0;      // x8 (fp)         (0x10)
+        Register s1;      // x9              (0x18)
+        Register s2;      // x18             (0x20)
+        Register s3;      // x19             (0x28)
+        Register s4;      // x20             (0x30)
+        Register s5;      // x21             (0x38)
+        Register s6;      // x22             (0x40)
+        Register s7;      // x23             (0x48)
+        Register s8;      // x24             (0x50)
+        Register s9;      // x25             (0x58)
+        Register s10;     // x26             (0x60)
+        Register s11;     // x27             (0x68)
+    };
+
+    // Floating point registers of the thread, they are saved and loaded lazily (k_fp_context.S), only for the threads that use them. FS field of sstatus tells in which state they are.
+    // FS is Off whenever the thread is switched to, so its first FP instruction traps, and its registers are loaded then. Clean ones are the same as in this save area, Dirty ones have been changed since.
+    struct FPContext {
+                          // RegisterName    Offset (in this FPContext struct)
+        Register f[32];   // f0-f31          (0x00-0xf8)
+        Register fcsr;    //                 (0x100)
+    };
+
+    constexpr uint64 SSTATUS_FS       = 3UL << 13;
+    constexpr uint64 SSTATUS_FS_OFF   = 0UL << 13;
+    constexpr uint64 SSTATUS_FS_CLEAN = 2UL << 13;
+    constexpr uint64 SSTATUS_FS_DIRTY = 3UL << 13;
 }
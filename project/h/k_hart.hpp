@@ -0,0 +1,70 @@
+#pragma once
+
+#include "hw.h"
+#include "k_tcb.hpp"
+
+// Number of harts (CPU cores) that the kernel runs on, it is set in the Makefile, and it has to match the -smp option of QEMU.
+#ifndef CPU_CORE_COUNT
+#define CPU_CORE_COUNT 1
+#endif
+
+namespace Kernel {
+    constexpr uint64 MAX_HARTS = CPU_CORE_COUNT;
+
+    // Affinity mask with a bit for every hart, bit i allows the thread to run on hart i.
+    constexpr uint64 ALL_HARTS_MASK = (MAX_HARTS >= 64) ? ~0UL : (1UL << MAX_HARTS) - 1;
+
+    // State of the kernel that every hart has on its own.
+    struct Hart {
+        uint64 id;
+
+        // Thread that is running on the hart, and thread that runs when there are no ready threads for this hart.
+        TCB* current_tcb;
+        TCB* idle_tcb;
+
+        // How many ticks have passed since the last context switch on this hart, and mtime of the last tick that was counted on this hart.
+        time_t volatile timer_ticks;
+        uint64 last_tick;
+
+        // How many timer interrupts the hart has taken, used only to see that the timer is not periodic.
+        uint64 n_timer_interrupts;
+
+        // How many times the hart has switched from one thread to another, the system call statistics use it to tell the calls that ran through from the ones that gave up the hart.
+        uint64 n_context_switches;
+
+        // How many times the hart has loaded and saved the floating point registers of threads, used only to see that the threads which don't use them don't pay for them.
+        uint64 n_fp_restores;
+        uint64 n_fp_saves;
+    };
+
+    extern Hart harts[MAX_HARTS];
+
+    // The sscratch register of every hart always holds the address of the context of the thread that runs on it, the trap handlers find the context there.
+    // Context is the first field of the TCB, so that is the address of the TCB as well, and through the TCB we know on which hart we are.
+    inline Context* get_current_context() {
+        Context* context;
+        __asm__ volatile ("csrr %0, sscratch" : "=r" (context));
+        return context;
+    }
+
+    inline TCB* get_current_tcb() {
+        return (TCB*)get_current_context();
+    }
+
+    inline Hart& get_hart() {
+        return harts[get_current_tcb()->hart];
+    }
+
+    // Big kernel lock, every trap handler takes it at the start, and releases it at the end. The hart that holds it can take it again.
+    // Thread may switch to another thread in the middle of the kernel, the lock stays with the hart, and the other thread releases it on its way out of the kernel.
+    void lock_kernel();
+    void unlock_kernel();
+    extern "C" void k_unlock_kernel();
+
+    // Lets the other harts, that wait since the boot, start running threads. Hart 0 calls it once the kernel is initialized.
+    void release_harts();
+
+    // Entry points of the other harts, k_start_hart runs in the machine mode and sets the hart up just like hw.lib sets up hart 0, k_hart_main runs in the supervisor mode.
+    extern "C" void k_start_hart(uint64 hart_id);
+    extern "C" void k_hart_main(uint64 hart_id);
+}
@@ -2,24 +2,118 @@
 
 #include "hw.h"
 
+// Backend of the kernel heap, chosen in the Makefile. 0 is for segregated free lists with Best-Fit fallback, 1 is for the binary buddy system.
+#ifndef MEM_BUDDY_ALLOCATOR
+#define MEM_BUDDY_ALLOCATOR 0
+#endif
+
 namespace Kernel {
     typedef uint32 blocks_t;
 
     class MemoryAllocator {
     private:
+#if MEM_BUDDY_ALLOCATOR == 1
         struct FreeBlocks {
             FreeBlocks* next;
             FreeBlocks* prev;
+        };
+
+        // Free list for every order, element of order k has 2^k blocks, and its address (relative to heap start) is aligned to 2^k blocks.
+        constexpr static int MAX_ORDERS = 32;
+
+        // Every block has one byte in order table, the first block of a free/used element holds the flag and the order of that element, other blocks hold 0.
+        constexpr static uint8 ORDER_MASK = 0x3F;
+        constexpr static uint8 FREE_FLAG  = 0x40;
+        constexpr static uint8 USED_FLAG  = 0x80;
+
+        // Heap start is aligned to this many bytes, so that elements of the buddy system are aligned to their size in absolute addresses as well, up to this size.
+        constexpr static uint64 HEAP_ALIGNMENT = 64 * 1024;
+
+        FreeBlocks* free_lists[MAX_ORDERS];
+        uint64 orders_map;
+        uint8* order_table;
+        blocks_t total_blocks;
+
+        MemoryAllocator();
+
+        void push_free(blocks_t idx, int order);
+        void unlink_free(blocks_t idx, int order);
+        void* alloc_order(int order);
+#else
+        struct FreeBlocks {
+            // Links in the AVL tree of free elements that is ordered by addresses (used for finding neighbours to merge with), its height in that tree, and size of the biggest element in its subtree.
+            // And neighbours in the list of the size class (bin) this element belongs to.
+            FreeBlocks* left;
+            FreeBlocks* right;
+            FreeBlocks* parent;
+            FreeBlocks* bin_next;
+            FreeBlocks* bin_prev;
             blocks_t n_blocks;
+            blocks_t max_blocks;
+            int height;
         };
 
-        // Pointers to the freeblocks linkedlist that keeps track of which blocks are free, and the allocation table, that keeps track of how many blocks were allocated for each memory allocation.
-        FreeBlocks* fb_head;
-        blocks_t* alloc_table;
+        // Every size from 1 up to SMALL_BINS blocks has its own bin, so that all elements in it have exactly the same size.
+        // Bigger sizes are grouped into power of two bins, the bin k (counting from the first large one) holds sizes in [2^(k + 6), 2^(k + 7) - 1].
+        constexpr static blocks_t SMALL_BINS = 64;
+        constexpr static int LARGE_BINS = 26;
+        constexpr static int LARGE_BINS_SHIFT = 6;
+
+        // Root of the freeblocks tree that keeps track of which blocks are free, and two bitmaps with one bit per block, that keep track of memory allocations.
+        // Bit in start_map is set for the first block of every memory allocation, and bit in end_map for its last block (boundary tag), their distance is the size of the allocation.
+        FreeBlocks* fb_root;
+        uint64* start_map;
+        uint64* end_map;
+        blocks_t total_blocks;
+
+        // Bitmaps are not cleared at boot, only the words below this high-water mark are valid, the rest are cleared once the allocations reach them.
+        uint64 valid_words;
+
+        // Heads of the bins, and bitmaps which tell us which of the small/large bins are not empty, so that we can find the right bin without walking through empty ones.
+        FreeBlocks* bins[SMALL_BINS + LARGE_BINS];
+        uint64 small_bins_map;
+        uint32 large_bins_map;
 
         MemoryAllocator();
 
-        static int merge_blocks(FreeBlocks* fb);
+        static int get_bin_index(blocks_t n_blocks);
+        static int get_height(FreeBlocks* fb);
+        static blocks_t get_max_blocks(FreeBlocks* fb);
+        static bool update_node(FreeBlocks* fb);
+
+        void set_child(FreeBlocks* parent, FreeBlocks* old_child, FreeBlocks* new_child);
+        FreeBlocks* rotate_left(FreeBlocks* fb);
+        FreeBlocks* rotate_right(FreeBlocks* fb);
+        void rebalance(FreeBlocks* fb);
+
+        void tree_insert(FreeBlocks* fb);
+        void tree_remove(FreeBlocks* fb);
+        void tree_replace(FreeBlocks* old_fb, FreeBlocks* new_fb);
+        void find_neighbours(void* address, FreeBlocks** prev, FreeBlocks** next);
+
+        void put_in_bin(FreeBlocks* fb);
+        void take_from_bin(FreeBlocks* fb);
+        FreeBlocks* find_best_fit(blocks_t n_blocks);
+        FreeBlocks* find_linear_best_fit(blocks_t n_blocks);
+        blocks_t get_alloc_blocks(blocks_t idx);
+        void extend_maps(blocks_t idx);
+        void split_front(FreeBlocks* fb, blocks_t n_blocks);
+        void* take_blocks(FreeBlocks* fb, blocks_t n_blocks);
+        void release_blocks(void* address, blocks_t n_blocks);
+        int check_address(void* address, blocks_t* idx);
+#endif
+
+        // Counters of the heap usage, kept up to date by every alloc/free, so that reading them takes constant time.
+        blocks_t used_blocks;
+        uint64 n_free_extents;
+        uint64 n_allocs;
+        uint64 n_frees;
+        uint64 n_failed_allocs;
+
+        void* count_alloc(void* address);
+
+        // Changes the size of the memory allocation without moving it, returns MEM_FAILED in case that is not possible, and old size of the allocation through old_blocks.
+        int resize_in_place(void* address, blocks_t n_blocks, blocks_t* old_blocks);
 
     public:
         static MemoryAllocator& get_instance();
@@ -28,7 +122,19 @@ namespace Kernel {
         MemoryAllocator &operator=(const MemoryAllocator&) = delete;
 
         void* alloc(blocks_t n_blocks);
+        void* alloc_aligned(blocks_t n_blocks, blocks_t align_blocks);
         int free(void* address);
+        void* realloc(void* address, blocks_t n_blocks);
+
+        // Heap statistics, sizes are in blocks. Fragmentation index is in percents, it tells how much of the free memory is not in the largest free extent.
+        blocks_t get_total_blocks();
+        blocks_t get_used_blocks();
+        blocks_t get_largest_free_extent();
+        uint64 get_free_extent_count();
+        uint64 get_fragmentation_index();
+        uint64 get_alloc_count();
+        uint64 get_free_count();
+        uint64 get_failed_alloc_count();
 
         // Success/Failure codes.
         constexpr static int MEM_SUCCESS            =  0;
@@ -37,4 +143,9 @@ namespace Kernel {
         constexpr static int ADDRESS_IS_NOT_ALIGNED = -3;
         constexpr static int ADDRESS_IS_NOT_USED    = -4;
     };
+
+#if MEM_BUDDY_ALLOCATOR == 0
+    // Best-Fit goes through all of the free elements in the order of their addresses instead of through the bins, the way alloc did it before the bins. It is there only to measure what the bins save.
+    extern bool linear_best_fit;
+#endif
 }
@@ -1,17 +1,81 @@
 #pragma once
 
 #include "k_tcb.hpp"
+#include "k_hart.hpp"
 #include "list.hpp"
 
 namespace Kernel {
+    // Every static priority has its own multilevel feedback queue, every level of it has its own FIFO queue of ready threads, priority 0 and level 0 are picked first.
+    // Thread that uses its whole time slice on a level is demoted to the next one, where the time slice is twice as long, and thread that blocks is promoted back.
+    // Static priority is never changed by the scheduler, thread of lower priority runs only when there are no ready threads of higher priority.
+    // Every hart has its own run queue with all of that, new thread goes to the hart with the fewest threads, and after that it stays on the hart it ran on last.
+    // Hart whose run queue is empty steals from the tail of the run queue of the busiest hart, while the owner of the queue takes from its head, so that they rarely want the same thread.
+    // Thread runs only on the harts in its affinity mask, all the choices of the hart above (and the stealing) are made only among those harts.
+    // Real-time threads are in their own class, that runs ahead of all the others, they are run by the earliest deadline first (EDF), and each of them stays on the hart that admitted it.
+    // Every job of a real-time thread may run for at most its WCET, job that overruns it is cut off until the next period of its thread, so it can't take the capacity reserved for the others.
     class Scheduler {
+    public:
+        constexpr static int N_PRIORITIES     = 16;
+        constexpr static int DEFAULT_PRIORITY = 8;
+
+        // Time slice of a thread that is never preempted by the timer, it runs until it blocks, yields, or a thread of higher priority becomes ready.
+        constexpr static time_t UNBOUNDED_TIME_SLICE = ~(time_t)0;
+
     private:
-        List<TCB> queue;
-        TCB* flush_tcb;
+        constexpr static int MLFQ_LEVELS = 4;
+
+        // Every this many ticks all the threads are moved back to the top level, so that CPU bound threads on the lower levels don't starve.
+        constexpr static time_t BOOST_PERIOD = 100;
+
+        // Real-time capacity of a hart, in thousandths, thread takes wcet / deadline of it. EDF meets all the deadlines as long as the sum of that is at most the whole capacity (with deadlines up to the period).
+        constexpr static uint64 RT_CAPACITY = 1000;
+
+        constexpr static int N_QUEUES = N_PRIORITIES * MLFQ_LEVELS;
+
+        // Queues are ordered by priority and then by level, bit i of ready_map tells us that the queue i is not empty, so that we can find the first non-empty queue in constant time.
+        struct RunQueue {
+            List<TCB> queues[N_QUEUES];
+            uint64 ready_map;
+            uint64 n_ready;
+            time_t boost_ticks;
+
+            // How many threads this hart took from the other harts, and how many threads moved to this hart from the hart they ran on last (stolen ones included).
+            uint64 n_steals;
+            uint64 n_migrations;
+
+            // Ready real-time threads ordered by their absolute deadlines, and how much of the real-time capacity is taken.
+            List<TCB> rt_queue;
+            uint64 rt_utilization;
+
+            // How many of the ready threads every hart could steal, that is the best effort threads that have that hart in their affinity masks.
+            uint64 n_stealable[MAX_HARTS];
+        };
+
+        RunQueue run_queues[MAX_HARTS];
+
+        // Time slice of the top level for the threads that don't have their own, it can be changed at runtime.
+        time_t default_time_slice;
 
         Scheduler() = default;
         ~Scheduler() = default;
 
+        time_t get_level_slice(TCB* tcb, int level);
+        static int get_queue_index(TCB* tcb);
+        static bool is_idle(TCB* tcb);
+        static bool can_run_on(TCB* tcb, uint64 hart_id);
+        static bool should_preempt(TCB* tcb, TCB* running_tcb);
+        static uint64 get_rt_utilization(time_t wcet, time_t deadline);
+        static void reset_used_ticks(TCB* tcb);
+
+        uint64 get_load(uint64 hart_id);
+        uint64 get_least_loaded_hart(uint64 first_hart, uint64 affinity);
+        uint64 get_wake_hart(TCB* tcb);
+        void count_ready(RunQueue& run_queue, TCB* tcb, int delta);
+        void enqueue(TCB* tcb);
+        void dequeue(TCB* tcb);
+        TCB* steal_tcb(uint64 hart_id);
+        void boost(uint64 hart_id);
+
     public:
         static Scheduler& get_instance();
 
@@ -20,7 +84,45 @@ namespace Kernel {
 
         void initialize();
 
+        // Next thread for the hart that calls it, that is the idle thread of the hart if there are no ready threads for it.
         TCB* next_tcb();
         void put_tcb(TCB* tcb);
+        void timer_tick(time_t ticks);
+
+        // Tells the idle thread whether there is a ready thread that its hart could run (its own or one that it could steal), it is read without the kernel lock, so it is only a hint.
+        bool has_ready_tcbs(uint64 hart_id);
+
+        // Counters of the load balancing, summed up over all of the harts.
+        uint64 get_steal_count();
+        uint64 get_migration_count();
+
+        // Changes the static priority of the thread, if it is ready it is moved to the queue of the new priority right away.
+        int set_priority(TCB* tcb, int priority);
+
+        // Makes the thread a real-time one with the given period, relative deadline (0 for the same as the period) and worst case execution time, in ticks, its first job is released right away.
+        // It is admitted only if some hart has enough real-time capacity left for it (its own hart is tried first). Period of 0 makes it a best effort thread again.
+        int set_real_time(TCB* tcb, time_t period, time_t deadline, time_t wcet);
+        static bool is_real_time(TCB* tcb);
+
+        // Ends the current job of the real-time thread, counts a miss if it is past its deadline (or it has overrun its WCET), and returns after how many ticks the next job is released (0 if it already is).
+        time_t end_real_time_job(TCB* tcb, bool overrun = false);
+
+        // Restricts the thread to the harts in the mask, if it is ready or running on a hart that is not in it, it is moved to one that is. Real-time thread has to be admitted on one of those harts again.
+        int set_affinity(TCB* tcb, uint64 affinity);
+
+        // Time slice of the top level for the given thread (0 to use the default one, or UNBOUNDED_TIME_SLICE), it can't be set for a real-time thread. And the default time slice for all the other threads.
+        int set_time_slice(TCB* tcb, time_t time_slice);
+        int set_default_time_slice(time_t time_slice);
+
+        // Success/Failure codes.
+        constexpr static int PRIORITY_SUCCESS = 0;
+        constexpr static int PRIORITY_INVALID = -1;
+        constexpr static int TIME_SLICE_SUCCESS = 0;
+        constexpr static int TIME_SLICE_INVALID = -1;
+        constexpr static int RT_SUCCESS      =  0;
+        constexpr static int RT_INVALID      = -1;
+        constexpr static int RT_NOT_ADMITTED = -2;
+        constexpr static int AFFINITY_SUCCESS = 0;
+        constexpr static int AFFINITY_INVALID = -1;
     };
 }
@@ -22,6 +22,12 @@ namespace Kernel {
 
         int wait();
         int signal();
+
+        // Takes the semaphore only if that doesn't block the calling thread, returns whether it did.
+        bool try_wait();
+
+        // Same as count signals in a row, but it goes through the semaphore only once.
+        int signal(int count);
         int close();
 
         // Success/failure codes.
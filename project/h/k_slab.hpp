@@ -0,0 +1,67 @@
+#pragma once
+
+#include "hw.h"
+#include "list.hpp"
+
+namespace Kernel {
+    class SlabCache {
+    private:
+        // Header at the start of every slab, the objects come right after it. Bit i of free_map tells us whether i-th object of the slab is free.
+        struct Slab {
+            Slab* next;
+            Slab* prev;
+            SlabCache* cache;
+            uint64 free_map;
+            uint64 n_used;
+        };
+
+        // Slabs are aligned to their size, so the slab of an object is found by clearing the low bits of its address.
+        size_t object_size;
+        size_t slab_size;
+        uint64 objects_per_slab;
+
+        // Slabs that have at least one free object, slabs that are full, and one completely empty slab, kept so that alloc/free cycles don't go to the heap every time.
+        List<Slab> partial_slabs;
+        List<Slab> full_slabs;
+        Slab* empty_slab;
+
+        // Occupancy counters.
+        uint64 n_slabs;
+        uint64 n_used;
+
+        SlabCache(size_t object_size, size_t slab_size);
+
+        Slab* create_slab();
+        uint64 get_full_map();
+
+        // Finds the slab of the object and its index in that slab, returns MEM_SUCCESS only if the object is currently allocated from this cache.
+        // Address is all it has to go on, so an object that was freed and whose slot was given to a new object passes the check as that new object.
+        int find_object(void* object, Slab** slab, uint64* idx);
+
+        // Tells whether the slab is in one of the lists of this cache.
+        bool owns_slab(Slab* slab);
+
+    public:
+        // Identifiers of the kernel object caches.
+        constexpr static int TCB_CACHE   = 0;
+        constexpr static int SEM_CACHE   = 1;
+        constexpr static int STACK_CACHE = 2;
+        constexpr static int N_CACHES    = 3;
+
+        static SlabCache* get_cache(int cache_id);
+
+        SlabCache(const SlabCache&) = delete;
+        SlabCache &operator=(const SlabCache&) = delete;
+
+        void* alloc();
+        int free(void* object);
+
+        // Tells whether the address is an object that is currently allocated from this cache, used to check the handles that come from system calls (any value is safe to pass).
+        bool is_allocated(void* object);
+
+        size_t get_object_size();
+        uint64 get_objects_per_slab();
+        uint64 get_slab_count();
+        uint64 get_used_count();
+    };
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "hw.h"
+
+namespace Kernel {
+    // Lock for the data that is shared between the harts. It is taken with an atomic swap (amoswap instruction), and the hart that didn't get it spins until it is free.
+    // Interrupts have to be masked while the lock is held, otherwise the hart could be interrupted into the code that waits on the same lock, and it would spin forever.
+    class SpinLock {
+    private:
+        uint32 volatile locked;
+
+    public:
+        inline void lock() {
+            while (__atomic_exchange_n(&this->locked, 1, __ATOMIC_ACQUIRE)) {
+                // Spin with plain loads, so that the waiting harts don't keep taking the cache line away from the one that holds the lock.
+                while (this->locked);
+            }
+        }
+
+        inline void unlock() {
+            __atomic_store_n(&this->locked, 0, __ATOMIC_RELEASE);
+        }
+    };
+}
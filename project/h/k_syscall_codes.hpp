@@ -6,11 +6,25 @@ namespace Kernel {
     // System call codes (important for ABI)
     constexpr int MEM_ALLOC_CODE = 0x01;
     constexpr int MEM_FREE_CODE  = 0x02;
+    constexpr int SLAB_STATS_CODE = 0x03;
+    constexpr int MEM_STATS_CODE  = 0x04;
+    constexpr int MEM_ALLOC_ALIGNED_CODE = 0x05;
+    constexpr int MEM_REALLOC_CODE       = 0x06;
 
     constexpr int CREATE_THREAD_CODE   = 0x11;
     constexpr int THREAD_EXIT_CODE     = 0x12;
     constexpr int THREAD_DISPATCH_CODE = 0x13;
     constexpr int THREAD_JOIN_CODE     = 0x14;
+    constexpr int THREAD_SET_PRIORITY_CODE    = 0x15;
+    constexpr int THREAD_GET_PRIORITY_CODE    = 0x16;
+    constexpr int THREAD_SET_TIME_SLICE_CODE  = 0x17;
+    constexpr int SET_DEFAULT_TIME_SLICE_CODE = 0x18;
+    constexpr int SCHED_STATS_CODE            = 0x19;
+    constexpr int THREAD_SET_PERIODIC_CODE        = 0x1A;
+    constexpr int THREAD_WAIT_NEXT_PERIOD_CODE    = 0x1B;
+    constexpr int THREAD_GET_DEADLINE_MISSES_CODE = 0x1C;
+    constexpr int THREAD_SET_AFFINITY_CODE        = 0x1D;
+    constexpr int THREAD_GET_HART_CODE            = 0x1E;
 
     constexpr int SEM_OPEN_CODE   = 0x21;
     constexpr int SEM_CLOSE_CODE  = 0x22;
@@ -22,6 +36,8 @@ namespace Kernel {
     constexpr int GET_C_CODE = 0x41;
     constexpr int PUT_C_CODE = 0x42;
 
+    constexpr int SYSCALL_STATS_CODE = 0x51;
+
     // Additional system call, to switch to user mode.
     constexpr int USER_MODE_CODE = 0xFF;
 }
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "hw.h"
+#include "k_hart.hpp"
+#include "k_utils.hpp"
+#include "syscall_c.hpp"
+
+// Counters of the system calls (number of calls and latency histogram of every system call), set in the Makefile. 0 compiles them out of the trap handlers.
+#ifndef SYSCALL_STATS
+#define SYSCALL_STATS 1
+#endif
+
+namespace Kernel {
+    // Handler of one system call, it writes what the system call returns to result (FAILED_SYSCALL at the start), and returns false only if it can't handle the system call this time.
+    // That is the case only for the fast handlers, for example sem_wait on a semaphore that can't be taken right away, the full path handles the system call then.
+    typedef bool (*SyscallHandler)(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4);
+
+    struct SyscallEntry {
+        const char* name;
+        SyscallHandler handler;
+
+        // Handler for the fast path of the trap, which may not switch threads (it is null for the system calls that may always block).
+        SyscallHandler fast_handler;
+    };
+
+    // System call codes are bytes, the high nibble of the code is the group (row of the table), and the low nibble is the system call in that group. Entries without a handler are unknown codes.
+    constexpr uint64 SYSCALL_GROUPS = 16;
+    constexpr uint64 SYSCALLS_PER_GROUP = 16;
+    constexpr uint64 SYSCALL_TABLE_SIZE = SYSCALL_GROUPS * SYSCALLS_PER_GROUP;
+
+    // Bucket i of the latency histogram counts the system calls that took [2^(i + 6), 2^(i + 7)) cycles, the first bucket counts the faster ones as well, and the last bucket the slower ones.
+    constexpr int SYSCALL_HISTOGRAM_SHIFT = 6;
+
+    // Statistics policy of the dispatcher that counts the system calls, and measures every one of them with the cycle counter of the hart. The kernel lock guards the counters.
+    // Call is counted once, by the path of the trap that handles it, the full path counts it before the handler, so that the calls which never return (thread_exit) are counted as well.
+    // Histogram is the time of the handler only for the calls that ran through on one go.
+    // Thread that was switched away from in the system call (it blocked, slept or yielded) took the time of the other threads, and it may come back on another hart, so such call is not in the histogram.
+    class SyscallStatsEnabled {
+    private:
+        struct Counters {
+            uint64 calls;
+            uint64 histogram[SYSCALL_HISTOGRAM_BUCKETS];
+        };
+
+        static Counters counters[SYSCALL_TABLE_SIZE];
+
+    public:
+        struct Sample {
+            uint64 cycles;
+            uint64 hart_id;
+            uint64 n_context_switches;
+        };
+
+        static void count(uint64 syscall_code) {
+            counters[syscall_code].calls++;
+        }
+
+        static Sample start() {
+            Hart& hart = get_hart();
+            return { Utils::read_cycle(), hart.id, hart.n_context_switches };
+        }
+
+        static void record(uint64 syscall_code, Sample sample) {
+            // The same hart that hasn't switched threads since the start means that the thread has never left it, so both cycles come from the same counter, and all of them are its own.
+            Hart& hart = get_hart();
+            if (hart.id == sample.hart_id && hart.n_context_switches == sample.n_context_switches) {
+                int bucket = Utils::floor_log2(Utils::read_cycle() - sample.cycles) - SYSCALL_HISTOGRAM_SHIFT;
+                bucket = (bucket < 0) ? 0 : (bucket >= SYSCALL_HISTOGRAM_BUCKETS) ? SYSCALL_HISTOGRAM_BUCKETS - 1 : bucket;
+                counters[syscall_code].histogram[bucket]++;
+            }
+        }
+
+        static void read(uint64 syscall_code, syscall_stats_t* stats) {
+            stats->calls = counters[syscall_code].calls;
+            for (int i = 0; i < SYSCALL_HISTOGRAM_BUCKETS; ++i) {
+                stats->histogram[i] = counters[syscall_code].histogram[i];
+            }
+        }
+    };
+
+    // Statistics policy of the dispatcher that does nothing, so the trap handlers pay nothing for the statistics, and all the counters read as 0.
+    class SyscallStatsDisabled {
+    public:
+        struct Sample { };
+
+        static void count(uint64 syscall_code) { }
+
+        static Sample start() {
+            return Sample();
+        }
+
+        static void record(uint64 syscall_code, Sample sample) { }
+
+        static void read(uint64 syscall_code, syscall_stats_t* stats) {
+            stats->calls = 0;
+            for (int i = 0; i < SYSCALL_HISTOGRAM_BUCKETS; ++i) {
+                stats->histogram[i] = 0;
+            }
+        }
+    };
+
+    // Calls the handlers from the system call table, both the fast and the full path of the ecall trap go through it, with the kernel lock taken.
+    template<typename StatsPolicy>
+    class SyscallDispatcher {
+    public:
+        // Returns false if the entry has no handler for that path, or if the handler can't handle the system call this time, result is valid only if it returns true.
+        static bool call(uint64 syscall_code, const SyscallEntry& entry, bool fast, uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+            SyscallHandler handler = fast ? entry.fast_handler : entry.handler;
+            if (!handler) {
+                return false;
+            }
+
+            // Fast handler that can't handle the call gives it to the full path, which counts it then, so the fast path counts only the calls it has handled.
+            if (!fast) {
+                StatsPolicy::count(syscall_code);
+            }
+
+            typename StatsPolicy::Sample sample = StatsPolicy::start();
+            if (!handler(result, p0, p1, p2, p3, p4)) {
+                return false;
+            }
+
+            if (fast) {
+                StatsPolicy::count(syscall_code);
+            }
+            StatsPolicy::record(syscall_code, sample);
+            return true;
+        }
+
+        static void read_stats(uint64 syscall_code, syscall_stats_t* stats) {
+            StatsPolicy::read(syscall_code, stats);
+        }
+    };
+
+#if SYSCALL_STATS == 1
+    typedef SyscallDispatcher<SyscallStatsEnabled> Syscalls;
+#else
+    typedef SyscallDispatcher<SyscallStatsDisabled> Syscalls;
+#endif
+}
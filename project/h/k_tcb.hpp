@@ -10,8 +10,16 @@ namespace Kernel {
 
     struct TCB {
         // Context of the thread, all the registers of the CPU are here (which includes stack pointer that points to the stack of the thread, etc).
+        // It has to be the first field, as the address of the context of the running thread (in sscratch) is the address of its TCB as well.
         Context context;
 
+        // Registers of the thread in the kernel, saved once some other thread is switched to, the thread continues from them (on its kernel stack) once it is switched back to.
+        SwitchContext switch_context;
+
+        // Floating point registers of the thread, valid only once it has used them (before that it starts from zeroed registers), and only while FS in its sstatus is not Dirty.
+        FPContext fp_context;
+        bool fp_used;
+
         // All threads have two stacks, user stack (used for running the user program), and system kernel stack (used for kernel operations).
         // In case user stack is full, we can still execute kernel operations as we have kernel stack.
         uint64* usr_stack;
@@ -21,11 +29,37 @@ namespace Kernel {
         bool interrupted;
         Sem* join_sem;
 
-        // For how long should the thread sleep, what is its timeslice, and status.
+        // For how long should the thread sleep, what is left of its timeslice, and status.
         time_t sleep_for;
         time_t time_slice;
         TCBStatus status;
 
+        // Time slice that the thread asked for on the top level, 0 if it uses the default one of the scheduler.
+        time_t own_time_slice;
+
+        // Static priority of the thread (0 is the highest), its level in the multilevel feedback queue of that priority, and how many ticks it has used on that level so far (in its current job, for a real-time thread).
+        int priority;
+        int level;
+        time_t used_ticks;
+
+        // Hart that runs the thread, or that ran it last, the thread is put back to the run queue of that hart.
+        uint64 hart;
+
+        // Harts on which the thread may run, bit i stands for hart i, the scheduler never puts the thread on a hart that is not in it.
+        uint64 affinity;
+
+        // Real-time (EDF) parameters of the thread, period of 0 means that it is a best effort thread. Period, relative deadline and worst case execution time are in ticks.
+        // Release and absolute deadline of the current job are in ticks since the boot, and misses counts the jobs that finished after their deadline.
+        time_t rt_period;
+        time_t rt_deadline;
+        time_t rt_wcet;
+        time_t rt_release;
+        time_t rt_abs_deadline;
+        uint64 rt_misses;
+
+        // Hart that admitted the real-time thread, its capacity is reserved there, and the thread is always put back to it.
+        uint64 rt_hart;
+
         // What function to run the thread on, and what arguments to pass to that function.
         void (*body)(void* args);
         void* args;
@@ -35,18 +69,16 @@ namespace Kernel {
         TCB* prev;
     };
 
-    // External declarations for the main thread of main() function, and currently running thread.
-    // And also external declaration for current context, yes we can read it from current_tcb, but its easier to have it declared like this as well, so that we can deal with it easier in assembly.
+    // External declaration for the main thread of main() function. Currently running thread, its context, and ticks since the last context switch are per hart (k_hart.hpp).
     extern TCB main_tcb;
-    extern TCB* current_tcb;
-    extern "C" Context* k_current_context;
-
-    // How many ticks have passed since the last context switch.
-    extern time_t volatile timer_ticks;
 
     TCB* create_tcb(void (*body)(void* args), void* args, uint64* stack_space);
     void free_tcb(TCB* tcb);
 
+    // Thread of the handle that was passed to a system call (the calling thread for the null handle), or null if the handle is not a thread that is still alive.
+    // Thread that has exited has its TCB freed (and maybe reused), so the system calls that take a handle check it, instead of writing to freed memory.
+    TCB* get_live_tcb(TCB* handle);
+
     void yield(TCB* old_tcb, TCB* new_tcb);
     void dispatch();
 
@@ -54,7 +86,11 @@ namespace Kernel {
     extern "C" void k_tcb_run_wrapper();
 
     // Functions that are defined in RISC-V assembly, so we have external declaration to them.
-    extern "C" int  k_save_context(Context* context);
-    extern "C" int  k_restore_context(Context* context);
+    // The whole register file of the thread is saved by the trap entry, so k_switch_context saves only what a function call has to preserve, yield is always called from C++ code.
+    extern "C" void k_switch_context(SwitchContext* old_context, SwitchContext* new_context);
     extern "C" void k_tcb_start();
+
+    // Save/load the floating point registers (and fcsr) of the thread, FS of sstatus has to be on for both of them.
+    extern "C" void k_save_fp_context(FPContext* fp_context);
+    extern "C" void k_restore_fp_context(FPContext* fp_context);
 }
@@ -8,6 +8,12 @@ namespace Kernel {
     class TCBSleepQueue : private List<TCB> {
     public:
         void put_to_sleep(TCB* tcb, time_t sleep_for);
-        void timer_tick();
+
+        // Counts the given number of ticks at once, and wakes up all the threads whose time has come.
+        void timer_tick(time_t ticks);
+
+        // Number of ticks after which the first thread wakes up, the queue must not be empty.
+        time_t get_first_sleep_for();
+        using List<TCB>::is_empty;
     };
 }
@@ -3,12 +3,27 @@
 namespace Kernel::Tests 
 {
     void memory_test();
+    void memory_benchmark();
+    void aligned_realloc_test();
+    void cpp_arena_test();
+    void slab_cache_test();
 
     void threads_test();
     void thread_exit_test();
     void semaphore_test();
+    void scheduler_test();
+    void priority_test();
+    void time_slice_test();
+    void smp_benchmark();
+    void context_switch_benchmark();
+    void syscall_benchmark();
+    void syscall_stats_test();
+    void affinity_test();
+    void tickless_test();
     void time_sleep_test();
     void periodic_thread_test();
+    void edf_test();
+    void fp_test();
 
     void console_io_test();
 
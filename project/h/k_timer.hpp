@@ -0,0 +1,58 @@
+#pragma once
+
+#include "hw.h"
+#include "k_tcb.hpp"
+#include "k_tcb_sleep_queue.hpp"
+
+namespace Kernel {
+    // The kernel is tickless, the timer of every hart is programmed only for the next event that the hart has to handle. That is the end of the time slice of the thread it is running.
+    // And for hart 0, also the wake up of the first sleeping thread. A hart that runs its idle thread, and has nothing else to wait for, takes no timer interrupts at all.
+    // Time is still measured in ticks of TIMER_INTERVAL, all the ticks that have passed are counted at once, whenever the timer interrupts us, or a thread gives up the CPU.
+    class Timer {
+    public:
+        // Every hart has its own mtimecmp register in the CLINT, the timer interrupts the hart once mtime reaches it. Tick is a tenth of a second at 10MHz, the same as the one of hw.lib.
+        constexpr static uint64 CLINT_MTIMECMP_ADDR = 0x02004000;
+        constexpr static uint64 TIMER_INTERVAL = 1000000;
+
+    private:
+        // Hart that wakes up the sleeping threads, any hart counts the ticks for them, but only this one programs its timer for them.
+        constexpr static uint64 SLEEP_HART = 0;
+        constexpr static uint64 NO_DEADLINE = ~0UL;
+
+        // Queue in which we store threads that requested to sleep for some time, and mtime of the last tick that was counted for it.
+        TCBSleepQueue sleep_queue;
+        uint64 sleep_last_tick;
+
+        // Ticks since the boot are counted from here, on the same grid as the ticks of the sleeping threads.
+        uint64 boot_time;
+
+        Timer() = default;
+        ~Timer() = default;
+
+        static uint64 volatile* get_mtimecmp(uint64 hart_id);
+        void arm(uint64 hart_id, uint64 deadline);
+        uint64 get_sleep_deadline();
+
+    public:
+        static Timer& get_instance();
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        void initialize();
+
+        // Counts the ticks that have passed since the last time, for this hart (its current thread and its run queue), and for the sleeping threads, which may wake some of them up.
+        void update();
+
+        // Programs the timer of this hart for the next event it has to handle, it is done every time a thread starts running on the hart.
+        void program();
+
+        // Makes the hart take a timer interrupt right away, so that it notices that it should switch threads (for example, it is idle, and a thread was put to its run queue).
+        void wake_hart(uint64 hart_id);
+
+        void put_to_sleep(TCB* tcb, time_t ticks);
+
+        // Number of whole ticks since the boot, the sleeping threads wake up exactly on these ticks.
+        time_t get_ticks();
+    };
+}
@@ -19,9 +19,22 @@ namespace Kernel {
     extern Sem putc_sem;
     extern Sem getc_sem;
 
+    // Registers of the console (UART) that hw.h doesn't have, relative to its base address, which is the address of CONSOLE_TX_DATA.
+    // IER enables the interrupts of the console, for received data (bit 0), and for the empty transmit holding register (bit 1).
+    constexpr uint64 CONSOLE_IER_OFFSET = 1;
+    constexpr uint64 CONSOLE_IIR_OFFSET = 2;
+    constexpr uint8 CONSOLE_IER_RX_TX = 0x03;
+
+    // Sends characters from the putc buffer for as long as the console can take them, the rest are sent once the console interrupts us that it can take more.
     void flush_putc_buffer();
     void fill_getc_buffer();
 
+    // Fast path of the system calls that never switch threads, the trap entry saves only the caller-saved registers for it. It returns 0 if the system call has to go through the full path (k_handle_ecall).
+    // The first FP instruction of a thread after it was switched to traps as an illegal instruction, and its FP registers are loaded on this path as well.
+    // The fast path can be turned off, so that the full path can be measured for the same system calls.
+    extern bool fast_syscalls;
+    extern "C" int k_handle_fast_ecall(uint64 syscall_code, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4, uint64 p5, uint64 p6);
+
     extern "C" void k_handle_ecall(uint64 syscall_code, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4, uint64 p5, uint64 p6);
     extern "C" void k_handle_timer(uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64 a4, uint64 a5, uint64 a6, uint64 a7);
     extern "C" void k_handle_console(uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64 a4, uint64 a5, uint64 a6, uint64 a7);
@@ -3,14 +3,62 @@
 typedef uint32 blocks_t;
 
 namespace Kernel::Utils {
+    // Address of the memory mapped mtime register of the CLINT on QEMU virt machine, PMP allows us to read it from both supervisor and user mode.
+    constexpr uint64 CLINT_MTIME_ADDR = 0x0200BFF8;
+
     // Just small inline functions (therefore they are exempted from the ODR one definition rule), used for general stuff.
     
+    inline uint64 read_mtime() {
+        // Read the free running machine timer, it is incremented at a constant rate (10MHz on QEMU virt), so it is good enough for measuring how long something took.
+        return *((uint64 volatile*)CLINT_MTIME_ADDR);
+    }
+
+    inline uint64 read_cycle() {
+        // Read the cycle counter of this hart, the kernel lets both supervisor and user mode read it (mcounteren/scounteren). Cycles of different harts are not comparable.
+        uint64 cycles;
+        __asm__ volatile ("rdcycle %0" : "=r" (cycles));
+        return cycles;
+    }
+
     inline blocks_t to_blocks(size_t n_bytes) {
         // Calculate how many blocks are necessary to allocate n bytes of memory. If you would graph this function, it would look like "staircase".
         // IF MEM_BLOCK_SIZE = 64B, then for n_bytes=0, it would return us 0 as result. For n_bytes in range [1, MEM_BLOCK_SIZE], it would return us 1, and so on.
         return (n_bytes + (MEM_BLOCK_SIZE - 1)) / MEM_BLOCK_SIZE;
     }
 
+    inline int find_first_set(uint64 mask) {
+        // Index of the least significant bit that is set, or -1 if none is. RV64IMAFD has no bit manipulation instructions, and we don't link libgcc.
+        // So we isolate the lowest set bit with (mask & -mask), and multiply it by a De Bruijn sequence, which puts a unique 6 bit pattern in the top bits for every possible power of two.
+        static const uint8 index_table[64] = {
+             0,  1, 48,  2, 57, 49, 28,  3, 61, 58, 50, 42, 38, 29, 17,  4,
+            62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,  5,
+            63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+            46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,  9, 13,  8,  7,  6
+        };
+
+        if (mask == 0) {
+            return -1;
+        }
+
+        return index_table[((mask & -mask) * 0x03f79d71b4cb0a89UL) >> 58];
+    }
+
+    inline int floor_log2(uint64 number) {
+        // Index of the most significant bit that is set, or -1 for 0. Smear the highest bit to all lower positions, then keep only that highest bit, and find its index.
+        number |= number >> 1;
+        number |= number >> 2;
+        number |= number >> 4;
+        number |= number >> 8;
+        number |= number >> 16;
+        number |= number >> 32;
+        return find_first_set(number ^ (number >> 1));
+    }
+
+    inline int ceil_log2(uint64 number) {
+        // Smallest k such that 2^k is greater or equal to number, for 0 and 1 it is 0.
+        return (number <= 1) ? 0 : floor_log2(number - 1) + 1;
+    }
+
     inline uint64 get_decimal_weight(uint64 number) {
         // A single digit has at least weight of 1.
         uint64 weight = 1;
@@ -19,9 +19,14 @@ public:
     void add_first(T* t);
     void add_last(T* t);
 
+    // Adds the element right in front of the given one, which must be in this list, or at the end of the list if it is null.
+    void add_before(T* t, T* next);
+
     T* take_first();
     T* take_last();
 
+    void remove(T* t);
+
     inline T* peek_first() {
         return this->head;
     }
@@ -95,6 +100,22 @@ void List<T>::add_last(T* t) {
     }
 }
 
+template<class T>
+void List<T>::add_before(T* t, T* next) {
+    if (!next || next == this->head) {
+        (next) ? this->add_first(t) : this->add_last(t);
+        return;
+    }
+
+    if (t) {
+        // The new element goes between next and its predecessor, which exists, as next is not the head.
+        t->next = next;
+        t->prev = next->prev;
+        next->prev->next = t;
+        next->prev = t;
+    }
+}
+
 template<class T>
 T* List<T>::take_first() {
     T* t = this->head;
@@ -138,3 +159,27 @@ T* List<T>::take_last() {
     List<T>::unlink(t);
     return t;
 }
+
+template<class T>
+void List<T>::remove(T* t) {
+    if (!t) {
+        return;
+    }
+
+    // Unchain the element from anywhere in the list, it must be in this list. Its neighbours point to each other, or if it has none, head/tail are moved.
+    if (t->prev) {
+        t->prev->next = t->next;
+    }
+    else {
+        this->head = t->next;
+    }
+
+    if (t->next) {
+        t->next->prev = t->prev;
+    }
+    else {
+        this->tail = t->prev;
+    }
+
+    List<T>::unlink(t);
+}
@@ -5,6 +5,38 @@
 void* mem_alloc(size_t size);
 int mem_free(void* address);
 
+// Allocation whose address is a multiple of alignment (power of two), and change of the size of the allocation, that moves it only if it can't grow in place.
+void* mem_alloc_aligned(size_t size, size_t alignment);
+void* mem_realloc(void* address, size_t size);
+
+// Identifiers of the kernel object caches (for TCBs, semaphores and kernel stacks), and their occupancy counters.
+const int SLAB_CACHE_TCB   = 0;
+const int SLAB_CACHE_SEM   = 1;
+const int SLAB_CACHE_STACK = 2;
+
+struct slab_stats_t {
+    size_t object_size;
+    size_t objects_per_slab;
+    size_t slabs;
+    size_t objects_used;
+    size_t objects_free;
+};
+int slab_stats(int cache, slab_stats_t* stats);
+
+// Health of the kernel heap, sizes are in bytes, fragmentation is the percent of the free memory that is outside of the largest free extent.
+// Failed allocations are the ones the heap had no room for, requests for 0 bytes and invalid alignments are not counted.
+struct mem_stats_t {
+    size_t bytes_used;
+    size_t bytes_free;
+    size_t free_extents;
+    size_t largest_free_extent;
+    size_t fragmentation;
+    size_t allocs;
+    size_t frees;
+    size_t failed_allocs;
+};
+int mem_stats(mem_stats_t* stats);
+
 
 class _thread;
 typedef _thread* thread_t;
@@ -14,6 +46,55 @@ int thread_exit();
 void thread_dispatch();
 void thread_join(thread_t handle);
 
+// Static priorities of threads, 0 is the highest one. Thread of lower priority runs only when there are no ready threads of higher priority. Null handle stands for the calling thread.
+const int THREAD_PRIORITY_HIGHEST = 0;
+const int THREAD_PRIORITY_DEFAULT = 8;
+const int THREAD_PRIORITY_LOWEST  = 15;
+
+int thread_set_priority(thread_t handle, int priority);
+int thread_get_priority(thread_t handle);
+
+// Attributes that the thread is created with, the thread runs with them from its very first instruction. thread_create uses the default ones.
+struct thread_attr_t {
+    int priority;
+    time_t time_slice;
+    uint64 affinity;
+};
+
+int thread_create_attr(thread_t* handle, void (*start_routine)(void*), void* arg, const thread_attr_t* attr);
+
+// Time slice of the thread in timer ticks, on the top level of the scheduler (every lower level doubles it). Null handle stands for the calling thread.
+// TIME_SLICE_DEFAULT makes the thread use the default time slice of the system, and TIME_SLICE_UNBOUNDED lets the thread run until it blocks or yields.
+const time_t TIME_SLICE_DEFAULT   = 0;
+const time_t TIME_SLICE_UNBOUNDED = ~(time_t)0;
+
+int thread_set_time_slice(thread_t handle, time_t ticks);
+int thread_set_default_time_slice(time_t ticks);
+
+// Load balancing between the harts, how many ready threads were stolen by harts that had nothing to run, and how many threads moved to another hart (stolen or woken up there).
+struct sched_stats_t {
+    size_t harts;
+    size_t steals;
+    size_t migrations;
+};
+int sched_stats(sched_stats_t* stats);
+
+// Real-time (periodic) threads, they run ahead of all the other threads, by the earliest deadline first. Times are in timer ticks, deadline of 0 is the same as the period. Null handle stands for the calling thread.
+// Thread is admitted only if it fits into the real-time capacity of some hart, THREAD_NOT_ADMITTED is returned otherwise. Period of 0 makes it an ordinary thread again.
+const int THREAD_NOT_ADMITTED = -2;
+
+int thread_set_periodic(thread_t handle, time_t period, time_t deadline, time_t wcet);
+int thread_wait_next_period();
+int thread_get_deadline_misses(thread_t handle);
+
+// Harts on which the thread may run, bit i of the mask stands for hart i, bits of the harts that the kernel doesn't run on are ignored. Null handle stands for the calling thread.
+const uint64 THREAD_AFFINITY_ALL = ~(uint64)0;
+
+int thread_set_affinity(thread_t handle, uint64 mask);
+
+// Hart that the calling thread runs on, it may already be another one by the time the caller looks at it, unless the thread is pinned.
+int thread_get_hart();
+
 
 class _sem;
 typedef _sem* sem_t;
@@ -34,3 +115,19 @@ void putc(char c);
 
 
 int set_user_mode();
+
+
+// Statistics of every system call that the kernel has, how many times it was called, and the histogram of its latency in cycles (from the start to the end of its handler).
+// Bucket i of the histogram counts the calls that took [2^(i + 6), 2^(i + 7)) cycles, the first bucket counts the faster ones as well, and the last one the slower ones.
+// Calls are counted when they start, so the ones that never return (thread_exit) are counted too. Calls in which the thread gave up the hart (it blocked, slept or yielded) are not in the histogram.
+// Counters are 0 if the kernel is built with SYSCALL_STATS=0.
+const int SYSCALL_HISTOGRAM_BUCKETS = 16;
+
+struct syscall_stats_t {
+    size_t code;
+    const char* name;
+    size_t fast_path;
+    size_t calls;
+    size_t histogram[SYSCALL_HISTOGRAM_BUCKETS];
+};
+int syscall_stats(syscall_stats_t* stats, size_t max_entries);
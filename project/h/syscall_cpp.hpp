@@ -15,23 +15,36 @@ constexpr int THREAD_ALREADY_STARTED = -1;
 
 class Thread {
 public:
-    Thread(void (*body)(void*), void* arg);
+    Thread(void (*body)(void*), void* arg, int priority=THREAD_PRIORITY_DEFAULT);
     virtual ~Thread();
 
     int start();
     void join();
 
+    // Priority can be changed before and after the thread is started, the thread is created with it, so it never runs with the default one.
+    int set_priority(int priority);
+    int get_priority();
+
+    // Time slice on the top level of the scheduler, TIME_SLICE_DEFAULT or TIME_SLICE_UNBOUNDED (runs until it blocks or yields), it can be changed before and after the thread is started, the thread is created with it.
+    int set_time_slice(time_t ticks);
+
+    // Harts on which the thread may run (bit i for hart i), THREAD_AFFINITY_ALL by default, it can be changed before and after the thread is started, the thread is created with it.
+    int set_affinity(uint64 mask);
+
     static void dispatch();
     static int sleep(time_t);
 
 protected:
-    Thread();
+    Thread(int priority=THREAD_PRIORITY_DEFAULT);
     virtual void run(){}
 
 public:
     thread_t myHandle;
     void (*body)(void*);
     void* arg;
+    int priority;
+    time_t time_slice;
+    uint64 affinity;
 };
 
 
@@ -52,14 +65,22 @@ class PeriodicThread : public Thread {
 public:
     void terminate();
 
+    // Thread that declares its worst case execution time (in ticks) runs in the real-time class, by the earliest deadline first, if it is admitted, otherwise it just sleeps for the period between activations.
+    bool is_real_time();
+    int get_deadline_misses();
+
 protected:
-    PeriodicThread(time_t period);
+    PeriodicThread(time_t period, time_t wcet = 0, time_t deadline = 0);
     
     // This method is supposed to be overriden.
     virtual void periodicActivation() { }
 
 private:
     time_t volatile period;
+    time_t deadline;
+    time_t wcet;
+    bool volatile real_time;
+    int volatile deadline_misses;
 };
 
 
@@ -72,4 +93,5 @@ public:
     static void print_string(const char* message="", char end='\n');
     static void print_uint64(uint64 number=0, char end='\n');
     static char* get_string(int max_length=255);
+    static void print_mem_stats();
 };
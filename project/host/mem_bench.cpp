@@ -0,0 +1,156 @@
+#include "hw.h"
+#include "k_memory.hpp"
+#include "k_utils.hpp"
+#include "mem_bench_io.hpp"
+
+// Host (x86-64 Linux) build of the kernel heap. MemoryAllocator only needs the heap bounds, so here they point to a plain array, and the allocator replays alloc/free traces.
+// Usage: mem_bench [--heap <MiB>] [--interval <ops>] [--linear] (<trace file> | --synthetic <ops> <seed>), or mem_bench --generate <ops> <seed> to print a synthetic trace.
+// With --linear, segregated free lists look for the Best-Fit through all of the free elements instead of through the bins, so that the same trace shows what the bins save.
+const void* HEAP_START_ADDR = nullptr;
+const void* HEAP_END_ADDR = nullptr;
+
+// Default size of the heap matches the 128M QEMU guest, and by default the synthetic trace is replayed.
+constexpr uint64 DEFAULT_HEAP_MIB = 128;
+constexpr uint64 DEFAULT_SYNTHETIC_OPS = 1000000;
+constexpr uint64 DEFAULT_SAMPLES = 20;
+
+static bool equals(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static bool parse_uint64(const char* str, uint64* value) {
+    *value = 0;
+    if (!str || !*str) {
+        return false;
+    }
+
+    for (; *str; ++str) {
+        if (*str < '0' || *str > '9') {
+            return false;
+        }
+        *value = *value * 10 + (*str - '0');
+    }
+    return true;
+}
+
+static void print_sample(Kernel::MemoryAllocator& mem_allocator, long op) {
+    // One row of the fragmentation over time table.
+    Host::print("%10ld %12lu %12lu %14lu %8lu%%\n", op,
+        (uint64)mem_allocator.get_used_blocks() * MEM_BLOCK_SIZE / 1024,
+        mem_allocator.get_free_extent_count(),
+        (uint64)mem_allocator.get_largest_free_extent() * MEM_BLOCK_SIZE / 1024,
+        mem_allocator.get_fragmentation_index());
+}
+
+static int usage() {
+    Host::print("usage: mem_bench [--heap <MiB>] [--interval <ops>] [--linear] (<trace file> | --synthetic <ops> <seed>)\n");
+    Host::print("       mem_bench --generate <ops> <seed>\n");
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    using Kernel::MemoryAllocator;
+
+    uint64 heap_mib = DEFAULT_HEAP_MIB, interval = 0, n_synthetic = DEFAULT_SYNTHETIC_OPS, seed = 1;
+    const char* trace_path = nullptr;
+    bool generate = false, linear = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (equals(argv[i], "--heap") && i + 1 < argc && parse_uint64(argv[i + 1], &heap_mib) && heap_mib > 0) {
+            i++;
+        }
+        else if (equals(argv[i], "--interval") && i + 1 < argc && parse_uint64(argv[i + 1], &interval)) {
+            i++;
+        }
+        else if (equals(argv[i], "--linear") && !MEM_BUDDY_ALLOCATOR) {
+            linear = true;
+        }
+        else if ((equals(argv[i], "--synthetic") || equals(argv[i], "--generate")) && i + 2 < argc && parse_uint64(argv[i + 1], &n_synthetic) && parse_uint64(argv[i + 2], &seed)) {
+            generate = equals(argv[i], "--generate");
+            i += 2;
+        }
+        else if (argv[i][0] != '-' && !trace_path) {
+            trace_path = argv[i];
+        }
+        else {
+            return usage();
+        }
+    }
+
+    Host::TraceOp* ops;
+    unsigned long n_slots;
+    long n_ops = trace_path ? Host::load_trace(trace_path, &ops, &n_slots) : Host::generate_trace(n_synthetic, seed, &ops, &n_slots);
+    if (n_ops < 0) {
+        Host::print("mem_bench: can't read the trace\n");
+        return 1;
+    }
+
+    if (generate) {
+        Host::print_trace(ops, n_ops);
+        return 0;
+    }
+
+    // The heap is a plain array, with the same alignment that the kernel heap has after the kernel image, the allocator carves its metadata out of it just like in the kernel.
+    uint8* heap = (uint8*)Host::alloc_zeroed(heap_mib * 1024 * 1024 + MEM_BLOCK_SIZE);
+    void** addresses = (void**)Host::alloc_zeroed(sizeof(void*) * (n_slots ? n_slots : 1));
+    if (!heap || !addresses) {
+        Host::print("mem_bench: can't allocate the heap\n");
+        return 1;
+    }
+    HEAP_START_ADDR = (void*)(((uint64)heap + MEM_BLOCK_SIZE - 1) & ~(uint64)(MEM_BLOCK_SIZE - 1));
+    HEAP_END_ADDR = (void*)((uint64)HEAP_START_ADDR + heap_mib * 1024 * 1024 - 1);
+
+#if MEM_BUDDY_ALLOCATOR == 0
+    Kernel::linear_best_fit = linear;
+#endif
+
+    uint64 init_start = Host::now_ns();
+    MemoryAllocator& mem_allocator = MemoryAllocator::get_instance();
+    uint64 init_ns = Host::now_ns() - init_start;
+
+    if (interval == 0) {
+        interval = (n_ops / DEFAULT_SAMPLES) ? n_ops / DEFAULT_SAMPLES : 1;
+    }
+
+    Host::print("%s, %lu MiB heap, %lu usable blocks, %ld ops, init %lu ns\n", MEM_BUDDY_ALLOCATOR ? "buddy" : linear ? "segregated free lists (linear best-fit)" : "segregated free lists", heap_mib, (uint64)mem_allocator.get_total_blocks(), n_ops, init_ns);
+    Host::print("%10s %12s %12s %14s %9s\n", "op", "used KiB", "free extents", "largest KiB", "frag");
+
+    // Every operation is timed on its own, the sampling and the printing are outside of the timed part.
+    uint64 alloc_ns = 0, free_ns = 0, worst_alloc_ns = 0, worst_free_ns = 0, n_allocs = 0, n_frees = 0;
+    for (long i = 0; i < n_ops; ++i) {
+        if (ops[i].is_alloc) {
+            uint64 start = Host::now_ns();
+            addresses[ops[i].slot] = mem_allocator.alloc(Kernel::Utils::to_blocks(ops[i].size));
+            uint64 duration = Host::now_ns() - start;
+
+            alloc_ns += duration;
+            worst_alloc_ns = (duration > worst_alloc_ns) ? duration : worst_alloc_ns;
+            n_allocs++;
+        }
+        else if (addresses[ops[i].slot]) {
+            // If the allocation has failed, there is nothing to free.
+            uint64 start = Host::now_ns();
+            mem_allocator.free(addresses[ops[i].slot]);
+            uint64 duration = Host::now_ns() - start;
+
+            addresses[ops[i].slot] = nullptr;
+            free_ns += duration;
+            worst_free_ns = (duration > worst_free_ns) ? duration : worst_free_ns;
+            n_frees++;
+        }
+
+        if ((i + 1) % interval == 0 || i + 1 == n_ops) {
+            print_sample(mem_allocator, i + 1);
+        }
+    }
+
+    uint64 total_ns = (alloc_ns + free_ns) ? alloc_ns + free_ns : 1;
+    Host::print("ops/sec: %lu\n", (n_allocs + n_frees) * 1000000000UL / total_ns);
+    Host::print("alloc: %lu ops, mean %lu ns, worst %lu ns, failed %lu\n", n_allocs, n_allocs ? alloc_ns / n_allocs : 0, worst_alloc_ns, mem_allocator.get_failed_alloc_count());
+    Host::print("free:  %lu ops, mean %lu ns, worst %lu ns\n", n_frees, n_frees ? free_ns / n_frees : 0, worst_free_ns);
+    return 0;
+}
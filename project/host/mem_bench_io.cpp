@@ -0,0 +1,169 @@
+#include "mem_bench_io.hpp"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <unordered_map>
+#include <vector>
+
+namespace Host {
+    static long finish_trace(std::vector<TraceOp>& trace, TraceOp** ops) {
+        *ops = (TraceOp*)std::malloc(sizeof(TraceOp) * (trace.size() ? trace.size() : 1));
+        if (!*ops) {
+            return -1;
+        }
+
+        for (size_t i = 0; i < trace.size(); ++i) {
+            (*ops)[i] = trace[i];
+        }
+        return (long)trace.size();
+    }
+
+    long load_trace(const char* path, TraceOp** ops, unsigned long* n_slots) {
+        FILE* file = std::fopen(path, "r");
+        if (!file) {
+            return -1;
+        }
+
+        // Ids of the trace are mapped to dense slots, so that the replay can keep the addresses in a plain array. Id can be reused once it is freed.
+        std::unordered_map<unsigned long, unsigned long> live_slots;
+        std::vector<unsigned long> free_slots;
+        std::vector<TraceOp> trace;
+        *n_slots = 0;
+
+        char line[256];
+        long line_number = 0;
+        while (std::fgets(line, sizeof(line), file)) {
+            line_number++;
+
+            char type = 0;
+            unsigned long id = 0, size = 0;
+            if (line[0] == '#' || line[0] == '\n') {
+                continue;
+            }
+
+            int n_read = std::sscanf(line, " %c %lu %lu", &type, &id, &size);
+            if (type == 'a' && n_read == 3 && !live_slots.count(id)) {
+                unsigned long slot = *n_slots;
+                if (!free_slots.empty()) {
+                    slot = free_slots.back();
+                    free_slots.pop_back();
+                }
+                else {
+                    (*n_slots)++;
+                }
+
+                live_slots[id] = slot;
+                trace.push_back({ true, slot, size });
+            }
+            else if (type == 'f' && n_read >= 2 && live_slots.count(id)) {
+                unsigned long slot = live_slots[id];
+                live_slots.erase(id);
+                free_slots.push_back(slot);
+                trace.push_back({ false, slot, 0 });
+            }
+            else {
+                std::fprintf(stderr, "%s:%ld: malformed trace line\n", path, line_number);
+                std::fclose(file);
+                return -1;
+            }
+        }
+
+        std::fclose(file);
+        return finish_trace(trace, ops);
+    }
+
+    // Number of objects that the synthetic trace keeps alive on average, with the mix of sizes below that is around 40MiB.
+    constexpr unsigned long TARGET_LIVE = 2000;
+
+    long generate_trace(unsigned long n_ops, unsigned long seed, TraceOp** ops, unsigned long* n_slots) {
+        // Small linear congruential generator, so that the same seed gives the same trace on every host.
+        unsigned long state = seed * 6364136223846793005UL + 1442695040888963407UL;
+        auto next_random = [&state](unsigned long bound) {
+            state = state * 6364136223846793005UL + 1442695040888963407UL;
+            return (state >> 33) % bound;
+        };
+
+        std::vector<TraceOp> trace;
+        std::vector<unsigned long> live;
+        std::vector<unsigned long> free_slots;
+        *n_slots = 0;
+
+        while (trace.size() < n_ops) {
+            // Keep around TARGET_LIVE objects alive on average, so that the heap reaches a steady state instead of filling up.
+            if (live.empty() || next_random(100) < ((live.size() < TARGET_LIVE) ? 55UL : 45UL)) {
+                unsigned long kind = next_random(100), size;
+                if (kind < 60) {
+                    // Semaphores, TCBs, small buffers.
+                    size = 16 + next_random(496);
+                }
+                else if (kind < 85) {
+                    // Medium buffers, up to a few pages.
+                    size = 512 + next_random(16 * 1024);
+                }
+                else if (kind < 97) {
+                    // Stacks.
+                    size = 4096;
+                }
+                else {
+                    // Rare big buffers.
+                    size = 64 * 1024 + next_random(960 * 1024);
+                }
+
+                unsigned long slot = *n_slots;
+                if (!free_slots.empty()) {
+                    slot = free_slots.back();
+                    free_slots.pop_back();
+                }
+                else {
+                    (*n_slots)++;
+                }
+
+                live.push_back(slot);
+                trace.push_back({ true, slot, size });
+            }
+            else {
+                // Mostly free the recently allocated objects (short lifetimes), but sometimes an old one, which is what fragments the heap.
+                unsigned long idx = (next_random(4) == 0) ? next_random(live.size()) : live.size() - 1 - next_random(live.size() < 8 ? live.size() : 8);
+                unsigned long slot = live[idx];
+                live[idx] = live.back();
+                live.pop_back();
+                free_slots.push_back(slot);
+                trace.push_back({ false, slot, 0 });
+            }
+        }
+
+        return finish_trace(trace, ops);
+    }
+
+    void print_trace(const TraceOp* ops, long n_ops) {
+        // Slots are valid ids as well, so the printed trace replays exactly the same way as the generated one.
+        for (long i = 0; i < n_ops; ++i) {
+            if (ops[i].is_alloc) {
+                std::printf("a %lu %lu\n", ops[i].slot, ops[i].size);
+            }
+            else {
+                std::printf("f %lu\n", ops[i].slot);
+            }
+        }
+    }
+
+    void* alloc_zeroed(unsigned long bytes) {
+        return std::calloc(1, bytes);
+    }
+
+    unsigned long now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+    }
+
+    int print(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        int result = std::vprintf(format, args);
+        va_end(args);
+        return result;
+    }
+}
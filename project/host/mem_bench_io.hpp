@@ -0,0 +1,25 @@
+#pragma once
+
+// Everything that the host benchmark needs from the C/C++ standard library is here, behind plain types.
+// It has to be in its own translation unit, since hw.h defines size_t and time_t on its own, in a way that clashes with the ones from the standard library.
+
+namespace Host {
+    // One operation of the trace, the allocation is identified by its slot, which is the same for the alloc and the free of that allocation.
+    struct TraceOp {
+        bool is_alloc;
+        unsigned long slot;
+        unsigned long size;
+    };
+
+    // Trace is a text file, every line is either "a <id> <bytes>" or "f <id>", ids are arbitrary numbers (for example addresses), and lines starting with '#' are ignored.
+    // Returns the number of operations, and the number of distinct slots through n_slots, or -1 if the file can't be read or is malformed.
+    long load_trace(const char* path, TraceOp** ops, unsigned long* n_slots);
+
+    // Deterministic synthetic trace, a mix of short lived small objects, kernel sized stacks, and long lived bigger buffers.
+    long generate_trace(unsigned long n_ops, unsigned long seed, TraceOp** ops, unsigned long* n_slots);
+    void print_trace(const TraceOp* ops, long n_ops);
+
+    void* alloc_zeroed(unsigned long bytes);
+    unsigned long now_ns();
+    int print(const char* format, ...) __attribute__((format(printf, 1, 2)));
+}
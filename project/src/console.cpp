@@ -36,20 +36,16 @@ void Console::putc(char c) {
 constexpr int DELETE_KEY = 127;
 constexpr int ENTER_KEY  = 13;
 
-// Extended C++ API.
-void Console::print_string(const char* message, char end) {
-    // Lock the console as we are doing complex output. We don't want threads to be racing each other to do the complex output.
-    console_lock();
+// Output helpers that expect the console to be already locked, so that they can be a part of bigger complex output.
+static void put_string(const char* message, char end) {
     for (int i = 0; message[i] != '\0'; i++) {
         Console::putc(message[i]);
     }
     Console::putc(end);
-    console_unlock();
 }
 
-void Console::print_uint64(uint64 number, char end) {
+static void put_uint64(uint64 number, char end) {
     uint64 weight = Kernel::Utils::get_decimal_weight(number);
-    console_lock();
 
     while (weight) {
         // Perform integer division on "number" with "weight", and take remainder of it when dividing it with 10, so that we can take the digits from left to right.
@@ -59,6 +55,20 @@ void Console::print_uint64(uint64 number, char end) {
     }
 
     Console::putc(end);
+}
+
+
+// Extended C++ API.
+void Console::print_string(const char* message, char end) {
+    // Lock the console as we are doing complex output. We don't want threads to be racing each other to do the complex output.
+    console_lock();
+    put_string(message, end);
+    console_unlock();
+}
+
+void Console::print_uint64(uint64 number, char end) {
+    console_lock();
+    put_uint64(number, end);
     console_unlock();
 }
 
@@ -101,3 +111,21 @@ char* Console::get_string(int max_length) {
     console_unlock();
     return str;
 }
+
+void Console::print_mem_stats() {
+    mem_stats_t stats;
+    if (mem_stats(&stats) != 0) {
+        return;
+    }
+
+    // Print "name: value" on new line for every counter of the kernel heap, all of it at once, so that other threads can't mix their output in between.
+    const char* names[8] = { "BYTES USED:", "BYTES FREE:", "FREE EXTENTS:", "LARGEST FREE EXTENT:", "FRAGMENTATION %:", "ALLOCS:", "FREES:", "FAILED ALLOCS:" };
+    uint64 values[8] = { stats.bytes_used, stats.bytes_free, stats.free_extents, stats.largest_free_extent, stats.fragmentation, stats.allocs, stats.frees, stats.failed_allocs };
+
+    console_lock();
+    for (int i = 0; i < 8; ++i) {
+        put_string(names[i], ' ');
+        put_uint64(values[i], '\n');
+    }
+    console_unlock();
+}
@@ -1,17 +1,125 @@
 #include "syscall_cpp.hpp"
 
+// Objects created with new are served from a user level arena, so that the common small objects don't cost a system call (and a trap that saves the whole context).
+// Arena takes big chunks from the kernel heap with one system call, and cuts them into objects of a few size classes, that are reused through free lists of those classes.
+// Bigger objects go straight to the kernel heap. Every object has a small header in front of it, that tells from which size class it came from.
+namespace {
+    struct ObjectHeader {
+        // Next free object of the same size class, used only while the object is free.
+        ObjectHeader* next_free;
+        uint64 size_class;
+    };
+
+    // Header is 16B, so objects stay 16B aligned, as every chunk that we get from the kernel is aligned to MEM_BLOCK_SIZE.
+    constexpr uint64 HEADER_SIZE = sizeof(ObjectHeader);
+    constexpr uint64 CHUNK_SIZE = 8192;
+
+    // Sizes of the objects of every size class, they grow by a half, so at most a third of the object is wasted. Objects bigger than that are in LARGE_CLASS.
+    constexpr int N_CLASSES = 12;
+    constexpr uint64 LARGE_CLASS = N_CLASSES;
+    constexpr uint64 MAX_SMALL_SIZE = 1024;
+    constexpr uint64 class_sizes[N_CLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024 };
+
+    // Size class for every 16B step of the object size, so that finding it is just one load.
+    constexpr uint8 class_table[MAX_SMALL_SIZE / 16] = {
+         0,  1,  2,  3,  4,  4,  5,  5,  6,  6,  6,  6,  7,  7,  7,  7,
+         8,  8,  8,  8,  8,  8,  8,  8,  9,  9,  9,  9,  9,  9,  9,  9,
+        10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+        11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11
+    };
+
+    // Free lists of every size class, and the part of the last chunk that hasn't been cut into objects yet.
+    ObjectHeader* free_lists[N_CLASSES];
+    uint64 chunk_next = 0;
+    uint64 chunk_end = 0;
+
+    // Threads are preempted at any time, so the arena is guarded by a spinlock. If the lock is taken, we give the CPU to the thread that holds it, instead of spinning.
+    uint32 arena_lock = 0;
+
+    void lock_arena() {
+        while (__atomic_exchange_n(&arena_lock, 1, __ATOMIC_ACQUIRE)) {
+            thread_dispatch();
+        }
+    }
+
+    void unlock_arena() {
+        __atomic_store_n(&arena_lock, 0, __ATOMIC_RELEASE);
+    }
+
+    void* arena_alloc(size_t bytes) {
+        if (bytes > MAX_SMALL_SIZE) {
+            // Big objects come from the kernel heap directly, header just says that.
+            ObjectHeader* header = (ObjectHeader*)mem_alloc(HEADER_SIZE + bytes);
+            if (!header) {
+                return nullptr;
+            }
+
+            header->size_class = LARGE_CLASS;
+            return (void*)((uint64)header + HEADER_SIZE);
+        }
+
+        uint64 size_class = class_table[(bytes > 0) ? (bytes - 1) / 16 : 0];
+        uint64 object_size = HEADER_SIZE + class_sizes[size_class];
+
+        lock_arena();
+        ObjectHeader* header = free_lists[size_class];
+        if (header) {
+            // Reuse the object that was freed the most recently, it is most likely still in the cache.
+            free_lists[size_class] = header->next_free;
+        }
+        else {
+            if (chunk_next + object_size > chunk_end) {
+                // The rest of the current chunk is too small, it is left unused, and we take a new chunk from the kernel.
+                chunk_next = (uint64)mem_alloc(CHUNK_SIZE);
+                chunk_end = chunk_next ? chunk_next + CHUNK_SIZE : 0;
+            }
+
+            if (chunk_next) {
+                header = (ObjectHeader*)chunk_next;
+                chunk_next += object_size;
+            }
+        }
+        unlock_arena();
+
+        if (!header) {
+            return nullptr;
+        }
+
+        header->size_class = size_class;
+        return (void*)((uint64)header + HEADER_SIZE);
+    }
+
+    void arena_free(void* address) {
+        if (!address) {
+            return;
+        }
+
+        ObjectHeader* header = (ObjectHeader*)((uint64)address - HEADER_SIZE);
+        if (header->size_class == LARGE_CLASS) {
+            mem_free(header);
+            return;
+        }
+
+        // Small objects are never given back to the kernel, they are chained to the free list of their size class.
+        lock_arena();
+        header->next_free = free_lists[header->size_class];
+        free_lists[header->size_class] = header;
+        unlock_arena();
+    }
+}
+
 void* operator new(size_t bytes) {
-    return mem_alloc(bytes);
+    return arena_alloc(bytes);
 }
 
 void* operator new[](size_t bytes) {
-    return mem_alloc(bytes);
+    return arena_alloc(bytes);
 }
 
 void operator delete(void* address) noexcept {
-    mem_free(address);
+    arena_free(address);
 }
 
 void operator delete[](void* address) noexcept {
-    mem_free(address);
+    arena_free(address);
 }
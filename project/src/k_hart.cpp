@@ -0,0 +1,104 @@
+#include "k_hart.hpp"
+#include "k_spinlock.hpp"
+#include "k_timer.hpp"
+#include "k_utils.hpp"
+
+// The interrupt table of the kernel, and the machine mode timer interrupt handler of the hw.lib, which we reuse for the other harts.
+extern "C" void k_intr_table();
+extern "C" void timervec();
+
+namespace Kernel {
+    Hart harts[MAX_HARTS];
+
+    // Harts other than hart 0 boot on these stacks (hart 0 boots on the stack of the hw.lib), they are used only until the hart switches to its idle thread.
+    // Their number is read by k_entry, so that it can park the harts that QEMU has, but the kernel wasn't built for.
+    constexpr uint64 BOOT_STACK_SIZE = 4096;
+    extern "C" uint8 k_boot_stacks[MAX_HARTS][BOOT_STACK_SIZE] __attribute__((aligned(16)));
+    uint8 k_boot_stacks[MAX_HARTS][BOOT_STACK_SIZE] __attribute__((aligned(16)));
+    extern "C" const uint64 k_max_harts = MAX_HARTS;
+
+    // Scratch area of timervec for every hart: three saved registers, address of the mtimecmp of the hart, and the timer interval.
+    static uint64 timer_scratch[MAX_HARTS][5];
+
+    static bool volatile harts_released = false;
+
+    static SpinLock kernel_lock;
+    static uint64 volatile lock_owner = 0;
+    static uint64 lock_depth = 0;
+
+
+    void lock_kernel() {
+        // Owner is kept as the hart id + 1, so that 0 means that nobody holds the lock. Only the hart that holds the lock could have written its own id there.
+        uint64 owner = get_current_tcb()->hart + 1;
+        if (lock_owner == owner) {
+            lock_depth++;
+            return;
+        }
+
+        kernel_lock.lock();
+        lock_owner = owner;
+        lock_depth = 1;
+    }
+
+    void unlock_kernel() {
+        if (--lock_depth == 0) {
+            lock_owner = 0;
+            kernel_lock.unlock();
+        }
+    }
+
+    extern "C" void k_unlock_kernel() {
+        unlock_kernel();
+    }
+
+    void release_harts() {
+        __atomic_store_n(&harts_released, true, __ATOMIC_RELEASE);
+    }
+
+    extern "C" void k_start_hart(uint64 hart_id) {
+        // In MSTATUS set the MPP (Machine Previous Privilege) bits 12:11 to 01, so that mret takes us to the supervisor mode, into k_hart_main.
+        uint64 mstatus_val;
+        __asm__ volatile ("csrr %0, mstatus" : "=r" (mstatus_val));
+        __asm__ volatile ("csrw mstatus, %0" : : "r" ((mstatus_val & ~(3UL << 11)) | (1UL << 11)));
+        __asm__ volatile ("csrw mepc, %0" : : "r" ((uint64)k_hart_main));
+
+        // No paging, delegate all the exceptions and interrupts to the supervisor mode, and let the supervisor mode access all of the physical memory (PMP is per hart).
+        __asm__ volatile ("csrw satp, zero");
+        __asm__ volatile ("csrw medeleg, %0" : : "r" (0xFFFFUL));
+        __asm__ volatile ("csrw mideleg, %0" : : "r" (0xFFFFUL));
+        __asm__ volatile ("csrw pmpaddr0, %0" : : "r" (~0UL >> 10));
+        __asm__ volatile ("csrw pmpcfg0, %0" : : "r" (0xFUL));
+
+        // Program the first timer interrupt of this hart, timervec raises the supervisor software interrupt every time, and the kernel programs the next one from there.
+        uint64* mtimecmp = (uint64*)(Timer::CLINT_MTIMECMP_ADDR + 8 * hart_id);
+        *mtimecmp = Utils::read_mtime() + Timer::TIMER_INTERVAL;
+        timer_scratch[hart_id][3] = (uint64)mtimecmp;
+        timer_scratch[hart_id][4] = Timer::TIMER_INTERVAL;
+        __asm__ volatile ("csrw mscratch, %0" : : "r" ((uint64)timer_scratch[hart_id]));
+        __asm__ volatile ("csrw mtvec, %0" : : "r" ((uint64)timervec));
+
+        // Enable the machine mode interrupts, and the machine timer interrupt (MTIE, bit 7).
+        __asm__ volatile ("csrs mstatus, %0" : : "r" (1UL << 3));
+        __asm__ volatile ("csrs mie, %0" : : "r" (1UL << 7));
+
+        // Go to the supervisor mode, with the id of the hart as the argument of k_hart_main. Nothing runs after mret here, so a0 doesn't have to be marked as clobbered.
+        __asm__ volatile ("mv a0, %0; mret" : : "r" (hart_id));
+    }
+
+    extern "C" void k_hart_main(uint64 hart_id) {
+        // Wait until hart 0 initializes the kernel (heap, caches, scheduler and the idle threads).
+        while (!__atomic_load_n(&harts_released, __ATOMIC_ACQUIRE));
+
+        __asm__ volatile ("csrw stvec, %0" : : "r" ((uint64)k_intr_table | 1));
+        __asm__ volatile ("csrw scounteren, %0" : : "r" (0x7));
+
+        // From now on the hart is running its idle thread, which is switched to right away, the kernel lock is released on the way out (in k_tcb_start).
+        Hart& hart = harts[hart_id];
+        __asm__ volatile ("csrw sscratch, %0" : : "r" (&hart.idle_tcb->context));
+        lock_kernel();
+
+        // Only the software interrupt (timer) is enabled on this hart, the console interrupts are handled by hart 0, since the PLIC of hw.lib is set up only for it.
+        __asm__ volatile ("csrw sie, %0" : : "r" (0x02));
+        yield(nullptr, hart.idle_tcb);
+    }
+}
@@ -1,43 +1,48 @@
 #include "k_memory.hpp"
 #include "k_utils.hpp"
 
+#if MEM_BUDDY_ALLOCATOR == 0
+
 namespace Kernel {
     MemoryAllocator::MemoryAllocator() {
-        // Assuming, we don't have alignment and padding issues, calculate the maximum number of blocks we can allocate and number of entries of allocation table.
-        // N_MAX * MEM_BLOCK_SIZE + N_MAX * sizeof(blocks_t) = (END_ADDR - START_ADDR + 1)
-        // N_MAX * (MEM_BLOCK_SIZE + sizeof(blocks_t)) = (END_ADDR - START_ADDR + 1)
-        // N_MAX = (END_ADDR - START_ADDR + 1) / (MEM_BLOCK_SIZE + sizeof(blocks_t)) 
-
-        // Calculate the maximum number of blocks that we can allocate without regard to alignment, assume padding is zero.
-        blocks_t total_blocks = ((uint64)HEAP_END_ADDR - (uint64)HEAP_START_ADDR + 1) / (MEM_BLOCK_SIZE + sizeof(blocks_t));
-        uint32 padding_size = 0;
+        // Every block needs two bits, one in each of the bitmaps, so the maximum number of blocks we can allocate is given with:
+        // N_MAX * MEM_BLOCK_SIZE + N_MAX * 2 / 8 = (END_ADDR - START_ADDR + 1)
+        // N_MAX = (END_ADDR - START_ADDR + 1) * 4 / (4 * MEM_BLOCK_SIZE + 1)
+        blocks_t total_blocks = ((uint64)HEAP_END_ADDR - (uint64)HEAP_START_ADDR + 1) * 4 / (4 * MEM_BLOCK_SIZE + 1);
+        uint64 map_words = (total_blocks + 63) / 64;
 
-        // Now calculating N when we have padding and alignment issues, we want the second equation to hold.
-        // N * MEM_BLOCK_SIZE + N * sizeof(blocks_t) + padding = (END_ADDR - START_ADDR + 1)
-        // (START_ADDR + N * sizeof(blocks_t) + padding) % MEM_BLOCK == 0
+        // Place both of the bitmaps at the start of the heap. They are cleared lazily, as the allocations advance, so that the boot doesn't depend on the size of the heap.
+        this->start_map = (uint64*)(((uint64)HEAP_START_ADDR + sizeof(uint64) - 1) & ~(sizeof(uint64) - 1));
+        this->end_map = this->start_map + map_words;
+        this->valid_words = 0;
 
-        // If the second equation does not hold, sacrifice one block for alignment.
-        // The remainder operator gives us how many bytes we have extra, that ruin the alignment to MEM_BLOCK_SIZE.
-        // So MEM_BLOCK_SIZE minus that many bytes, gives us the size of padding we need to reach the alignment.
-        if (((uint64)HEAP_START_ADDR + total_blocks * sizeof(blocks_t)) % MEM_BLOCK_SIZE != 0) {
-            total_blocks = total_blocks - 1;
-            padding_size = MEM_BLOCK_SIZE - ((uint64)HEAP_START_ADDR + total_blocks * sizeof(blocks_t)) % MEM_BLOCK_SIZE;
+        // HEAP_START is now moved after the bitmaps, and aligned to MEM_BLOCK_SIZE. In case the alignment took up some space of the last block, we sacrifice that block.
+        uint64 heap_start = ((uint64)(this->end_map + map_words) + MEM_BLOCK_SIZE - 1) & ~(uint64)(MEM_BLOCK_SIZE - 1);
+        HEAP_START_ADDR = (void*)heap_start;
+        if ((uint64)total_blocks * MEM_BLOCK_SIZE > (uint64)HEAP_END_ADDR + 1 - heap_start) {
+            total_blocks = ((uint64)HEAP_END_ADDR + 1 - heap_start) / MEM_BLOCK_SIZE;
         }
 
-        // Initialize the allocation table with zeroes.
-        this->alloc_table = (blocks_t*)HEAP_START_ADDR;
-        for (blocks_t i = 0; i < total_blocks; ++i) {
-            this->alloc_table[i] = 0;
-        }
+        // Initialize the "in-band" tree, at the start it has only one element, the whole heap.
+        this->total_blocks = total_blocks;
+        this->used_blocks = 0;
+        this->n_free_extents = 0;
+        this->n_allocs = 0;
+        this->n_frees = 0;
+        this->n_failed_allocs = 0;
 
-        // HEAP_START is now moved after the table.
-        HEAP_START_ADDR = (void*)((uint64)HEAP_START_ADDR + total_blocks * sizeof(blocks_t) + padding_size);
+        this->fb_root = (FreeBlocks*)nullptr;
+        FreeBlocks* fb = (FreeBlocks*)HEAP_START_ADDR;
+        fb->n_blocks = total_blocks;
+        this->tree_insert(fb);
 
-        // Initialize the "in-band" linked list.
-        this->fb_head = (FreeBlocks*)HEAP_START_ADDR;
-        this->fb_head->n_blocks = total_blocks;
-        this->fb_head->next = (FreeBlocks*)nullptr;
-        this->fb_head->prev = (FreeBlocks*)nullptr;
+        // All the bins are empty at the start, except the one in which the whole heap belongs to.
+        for (int i = 0; i < (int)SMALL_BINS + LARGE_BINS; ++i) {
+            this->bins[i] = (FreeBlocks*)nullptr;
+        }
+        this->small_bins_map = 0;
+        this->large_bins_map = 0;
+        this->put_in_bin(fb);
     }
 
     MemoryAllocator& MemoryAllocator::get_instance() {
@@ -45,61 +50,468 @@ namespace Kernel {
         return mem_allocator;
     }
 
-    void* MemoryAllocator::alloc(blocks_t n_blocks) {
-        // Go through the list of free blocks, and try to find exactly n free blocks, or at least more than n, Best-Fit algorithm.
-        FreeBlocks* best = (FreeBlocks*)nullptr;
-        for (FreeBlocks* curr = this->fb_head; curr && (!best || best->n_blocks != n_blocks); curr = curr->next) {
-            if (curr->n_blocks >= n_blocks && (!best || curr->n_blocks < best->n_blocks)) {
-                best = curr;
-            }
+    int MemoryAllocator::get_height(FreeBlocks* fb) {
+        return fb ? fb->height : 0;
+    }
+
+    blocks_t MemoryAllocator::get_max_blocks(FreeBlocks* fb) {
+        return fb ? fb->max_blocks : 0;
+    }
+
+    bool MemoryAllocator::update_node(FreeBlocks* fb) {
+        // Height of the element in the tree is by one bigger than the height of its higher subtree, and the biggest element of the subtree is either this one, or the biggest in one of its subtrees.
+        int left_height = MemoryAllocator::get_height(fb->left);
+        int right_height = MemoryAllocator::get_height(fb->right);
+        int height = 1 + ((left_height > right_height) ? left_height : right_height);
+
+        blocks_t max_blocks = fb->n_blocks;
+        if (MemoryAllocator::get_max_blocks(fb->left) > max_blocks) {
+            max_blocks = fb->left->max_blocks;
+        }
+        if (MemoryAllocator::get_max_blocks(fb->right) > max_blocks) {
+            max_blocks = fb->right->max_blocks;
         }
 
-        if (best) {
-            blocks_t remaining_blocks = best->n_blocks - n_blocks;
-            if (Utils::to_blocks(sizeof(FreeBlocks)) <= remaining_blocks) {
-                // If there is enough memory left for header FreeBlocks, then we are creating new FreeBlocks element, and we are chaining it to the list.
-                FreeBlocks* new_fb = (FreeBlocks*)((uint64)best + n_blocks * MEM_BLOCK_SIZE);
-                new_fb->n_blocks = remaining_blocks;
-                new_fb->next = best->next;
-                new_fb->prev = best->prev;
-
-                if (new_fb->prev) {
-                    new_fb->prev->next = new_fb;
+        // Return whether anything has changed, if not, nothing above this element has to change either.
+        bool changed = (fb->height != height || fb->max_blocks != max_blocks);
+        fb->height = height;
+        fb->max_blocks = max_blocks;
+        return changed;
+    }
+
+    void MemoryAllocator::set_child(FreeBlocks* parent, FreeBlocks* old_child, FreeBlocks* new_child) {
+        // Let the parent point to the new child instead of the old one, in case there is no parent, the new child is the root.
+        if (!parent) {
+            this->fb_root = new_child;
+        }
+        else if (parent->left == old_child) {
+            parent->left = new_child;
+        }
+        else {
+            parent->right = new_child;
+        }
+    }
+
+    MemoryAllocator::FreeBlocks* MemoryAllocator::rotate_left(FreeBlocks* fb) {
+        // The right child takes the place of fb, fb becomes its left child, and the left subtree of the right child becomes the right subtree of fb.
+        FreeBlocks* pivot = fb->right;
+        fb->right = pivot->left;
+        if (fb->right) {
+            fb->right->parent = fb;
+        }
+
+        pivot->parent = fb->parent;
+        this->set_child(fb->parent, fb, pivot);
+        pivot->left = fb;
+        fb->parent = pivot;
+
+        MemoryAllocator::update_node(fb);
+        MemoryAllocator::update_node(pivot);
+        return pivot;
+    }
+
+    MemoryAllocator::FreeBlocks* MemoryAllocator::rotate_right(FreeBlocks* fb) {
+        // Mirrored rotate_left, the left child takes the place of fb.
+        FreeBlocks* pivot = fb->left;
+        fb->left = pivot->right;
+        if (fb->left) {
+            fb->left->parent = fb;
+        }
+
+        pivot->parent = fb->parent;
+        this->set_child(fb->parent, fb, pivot);
+        pivot->right = fb;
+        fb->parent = pivot;
+
+        MemoryAllocator::update_node(fb);
+        MemoryAllocator::update_node(pivot);
+        return pivot;
+    }
+
+    void MemoryAllocator::rebalance(FreeBlocks* fb) {
+        // Go from fb up to the root, fix the heights and the biggest sizes, and rotate wherever heights of two subtrees differ by more than one. The tree is O(log n) high, so is this.
+        // Also called whenever the size of fb changes in place. The walk stops early, once an element that needs no rotation hasn't changed.
+        while (fb) {
+            bool changed = MemoryAllocator::update_node(fb);
+            int balance = MemoryAllocator::get_height(fb->left) - MemoryAllocator::get_height(fb->right);
+
+            if (balance > 1) {
+                if (MemoryAllocator::get_height(fb->left->left) < MemoryAllocator::get_height(fb->left->right)) {
+                    this->rotate_left(fb->left);
+                }
+                fb = this->rotate_right(fb);
+            }
+            else if (balance < -1) {
+                if (MemoryAllocator::get_height(fb->right->right) < MemoryAllocator::get_height(fb->right->left)) {
+                    this->rotate_right(fb->right);
                 }
+                fb = this->rotate_left(fb);
+            }
+            else if (!changed) {
+                break;
+            }
+
+            fb = fb->parent;
+        }
+    }
+
+    void MemoryAllocator::tree_insert(FreeBlocks* fb) {
+        // Find the place of the new leaf by its address, chain it there, and rebalance the tree on the way back up.
+        FreeBlocks* parent = (FreeBlocks*)nullptr;
+        for (FreeBlocks* curr = this->fb_root; curr; curr = (fb < curr) ? curr->left : curr->right) {
+            parent = curr;
+        }
 
-                if (new_fb->next) {
-                    new_fb->next->prev = new_fb;
+        fb->left = (FreeBlocks*)nullptr;
+        fb->right = (FreeBlocks*)nullptr;
+        fb->parent = parent;
+        fb->height = 1;
+        fb->max_blocks = fb->n_blocks;
+        this->n_free_extents++;
+
+        if (!parent) {
+            this->fb_root = fb;
+        }
+        else if (fb < parent) {
+            parent->left = fb;
+        }
+        else {
+            parent->right = fb;
+        }
+
+        this->rebalance(parent);
+    }
+
+    void MemoryAllocator::tree_remove(FreeBlocks* fb) {
+        FreeBlocks* rebalance_from;
+        FreeBlocks* next_fb = (FreeBlocks*)nullptr;
+
+        if (fb->left && fb->right) {
+            // The element has both children, so the next element by address (leftmost in the right subtree) takes its place. Elements are in-band, so we relink them.
+            next_fb = fb->right;
+            while (next_fb->left) {
+                next_fb = next_fb->left;
+            }
+
+            if (next_fb->parent != fb) {
+                // Next element leaves its place to its right child, and takes over the right subtree of fb.
+                rebalance_from = next_fb->parent;
+                rebalance_from->left = next_fb->right;
+                if (next_fb->right) {
+                    next_fb->right->parent = rebalance_from;
                 }
 
-                if (this->fb_head == best) {
-                    this->fb_head = new_fb;
+                next_fb->right = fb->right;
+                next_fb->right->parent = next_fb;
+            }
+            else {
+                rebalance_from = next_fb;
+            }
+
+            next_fb->left = fb->left;
+            next_fb->left->parent = next_fb;
+            next_fb->parent = fb->parent;
+            next_fb->height = fb->height;
+            next_fb->max_blocks = fb->max_blocks;
+            this->set_child(fb->parent, fb, next_fb);
+        }
+        else {
+            // The element has at most one child, the child takes its place.
+            FreeBlocks* child = fb->left ? fb->left : fb->right;
+            if (child) {
+                child->parent = fb->parent;
+            }
+
+            this->set_child(fb->parent, fb, child);
+            rebalance_from = fb->parent;
+        }
+
+        this->n_free_extents--;
+        this->rebalance(rebalance_from);
+
+        if (next_fb) {
+            // The walk above may stop before it reaches the next element, which still holds the biggest size of the subtree of fb, that might have been fb itself.
+            this->rebalance(next_fb);
+        }
+    }
+
+    void MemoryAllocator::tree_replace(FreeBlocks* old_fb, FreeBlocks* new_fb) {
+        // The new element takes the place of the old one in the tree, this is only allowed if there is no other element with address between them.
+        new_fb->left = old_fb->left;
+        new_fb->right = old_fb->right;
+        new_fb->parent = old_fb->parent;
+        new_fb->height = old_fb->height;
+        new_fb->max_blocks = old_fb->max_blocks;
+
+        if (new_fb->left) {
+            new_fb->left->parent = new_fb;
+        }
+
+        if (new_fb->right) {
+            new_fb->right->parent = new_fb;
+        }
+
+        this->set_child(old_fb->parent, old_fb, new_fb);
+    }
+
+    void MemoryAllocator::find_neighbours(void* address, FreeBlocks** prev, FreeBlocks** next) {
+        // Go down the tree, every element with lower address is a candidate for prev (and the later ones are closer), and every other is a candidate for next.
+        *prev = (FreeBlocks*)nullptr;
+        *next = (FreeBlocks*)nullptr;
+
+        FreeBlocks* curr = this->fb_root;
+        while (curr) {
+            if ((void*)curr < address) {
+                *prev = curr;
+                curr = curr->right;
+            }
+            else {
+                *next = curr;
+                curr = curr->left;
+            }
+        }
+    }
+
+    int MemoryAllocator::get_bin_index(blocks_t n_blocks) {
+        // Small sizes map directly to their own bin, and large ones to the bin of their power of two (which comes after all the small bins).
+        if (n_blocks <= SMALL_BINS) {
+            return n_blocks - 1;
+        }
+
+        return SMALL_BINS + Utils::floor_log2(n_blocks) - LARGE_BINS_SHIFT;
+    }
+
+    void MemoryAllocator::put_in_bin(FreeBlocks* fb) {
+        // Chain the FreeBlocks element as the new head of its bin, and mark that bin as not empty.
+        int idx = MemoryAllocator::get_bin_index(fb->n_blocks);
+        fb->bin_prev = (FreeBlocks*)nullptr;
+        fb->bin_next = this->bins[idx];
+        if (fb->bin_next) {
+            fb->bin_next->bin_prev = fb;
+        }
+        this->bins[idx] = fb;
+
+        if (idx < (int)SMALL_BINS) {
+            this->small_bins_map |= (1UL << idx);
+        }
+        else {
+            this->large_bins_map |= (1U << (idx - SMALL_BINS));
+        }
+    }
+
+    void MemoryAllocator::take_from_bin(FreeBlocks* fb) {
+        // Unchain the FreeBlocks element from its bin, n_blocks must still be the same as when the element was put in the bin.
+        int idx = MemoryAllocator::get_bin_index(fb->n_blocks);
+        if (fb->bin_prev) {
+            fb->bin_prev->bin_next = fb->bin_next;
+        }
+        else {
+            this->bins[idx] = fb->bin_next;
+        }
+
+        if (fb->bin_next) {
+            fb->bin_next->bin_prev = fb->bin_prev;
+        }
+
+        if (!this->bins[idx]) {
+            // In case that was the last element of the bin, mark the bin as empty.
+            if (idx < (int)SMALL_BINS) {
+                this->small_bins_map &= ~(1UL << idx);
+            }
+            else {
+                this->large_bins_map &= ~(1U << (idx - SMALL_BINS));
+            }
+        }
+    }
+
+    bool linear_best_fit = false;
+
+    MemoryAllocator::FreeBlocks* MemoryAllocator::find_linear_best_fit(blocks_t n_blocks) {
+        // Start from the free element with the lowest address, and go to the next one in the tree, until the exact fit is found, or all of them are checked.
+        FreeBlocks* curr = this->fb_root;
+        while (curr && curr->left) {
+            curr = curr->left;
+        }
+
+        FreeBlocks* best = (FreeBlocks*)nullptr;
+        while (curr && (!best || best->n_blocks != n_blocks)) {
+            if (curr->n_blocks >= n_blocks && (!best || curr->n_blocks < best->n_blocks)) {
+                best = curr;
+            }
+
+            // Next element is the leftmost one in the right subtree, or if there is no right subtree, the first ancestor that has this subtree on its left.
+            if (curr->right) {
+                curr = curr->right;
+                while (curr->left) {
+                    curr = curr->left;
                 }
             }
             else {
-                // If there is not enough free blocks, we are unchaining the FreeBlocks element.
-                if (best->prev) {
-                    best->prev->next = best->next;
+                while (curr->parent && curr->parent->right == curr) {
+                    curr = curr->parent;
                 }
+                curr = curr->parent;
+            }
+        }
 
-                if (best->next) {
-                    best->next->prev = best->prev;
-                }
+        return best;
+    }
+
+    MemoryAllocator::FreeBlocks* MemoryAllocator::find_best_fit(blocks_t n_blocks) {
+        if (linear_best_fit) {
+            return this->find_linear_best_fit(n_blocks);
+        }
+
+        int first_large_bin = 0;
 
-                if (this->fb_head == best) {
-                    this->fb_head = best->next;
+        if (n_blocks <= SMALL_BINS) {
+            // Every small bin holds elements of exactly one size, so the first non empty bin that is not smaller than n_blocks gives us the best fit immediately.
+            int idx = Utils::find_first_set(this->small_bins_map & (~0UL << (n_blocks - 1)));
+            if (idx >= 0) {
+                return this->bins[idx];
+            }
+        }
+        else {
+            // Elements of the large bin for n_blocks may be smaller or bigger than n_blocks, so here we still have to go with the Best-Fit search through that bin.
+            first_large_bin = MemoryAllocator::get_bin_index(n_blocks) - SMALL_BINS;
+
+            FreeBlocks* best = (FreeBlocks*)nullptr;
+            for (FreeBlocks* curr = this->bins[SMALL_BINS + first_large_bin]; curr && (!best || best->n_blocks != n_blocks); curr = curr->bin_next) {
+                if (curr->n_blocks >= n_blocks && (!best || curr->n_blocks < best->n_blocks)) {
+                    best = curr;
                 }
             }
 
-            // Write for this memory allocation, for this address best, how many blocks have we allocated to the allocation table, and return the free memory location.
-            alloc_table[((uint64)best - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE] = n_blocks;
-            return (void*)best;
+            if (best) {
+                return best;
+            }
+
+            first_large_bin = first_large_bin + 1;
+            if (first_large_bin >= LARGE_BINS) {
+                return (FreeBlocks*)nullptr;
+            }
+        }
+
+        // Every element of any of the following large bins is bigger than n_blocks, so take the first non empty one, and find the best fit in it.
+        int idx = Utils::find_first_set(this->large_bins_map & (~0U << first_large_bin));
+        if (idx < 0) {
+            return (FreeBlocks*)nullptr;
+        }
+
+        FreeBlocks* best = this->bins[SMALL_BINS + idx];
+        for (FreeBlocks* curr = best->bin_next; curr; curr = curr->bin_next) {
+            if (curr->n_blocks < best->n_blocks) {
+                best = curr;
+            }
+        }
+
+        return best;
+    }
+
+    blocks_t MemoryAllocator::get_alloc_blocks(blocks_t idx) {
+        // Memory allocations don't overlap, so the first end tag at or after the first block of the allocation is its own. Whole words of the bitmap are skipped at once.
+        uint64 word = idx / 64;
+        uint64 bits = this->end_map[word] & (~0UL << (idx % 64));
+        while (!bits) {
+            bits = this->end_map[++word];
+        }
+
+        return (blocks_t)(word * 64 + Utils::find_first_set(bits)) - idx + 1;
+    }
+
+    void MemoryAllocator::extend_maps(blocks_t idx) {
+        // Clear the words of the bitmaps up to the one that holds the bit of block idx, no allocation ever reached them, so they must be all zeroes.
+        while (this->valid_words <= idx / 64) {
+            this->start_map[this->valid_words] = 0;
+            this->end_map[this->valid_words] = 0;
+            this->valid_words++;
+        }
+    }
+
+    void MemoryAllocator::split_front(FreeBlocks* fb, blocks_t n_blocks) {
+        // The first n_blocks of the FreeBlocks element (which has at least that many blocks) are no longer free.
+        this->take_from_bin(fb);
+
+        blocks_t remaining_blocks = fb->n_blocks - n_blocks;
+        if (Utils::to_blocks(sizeof(FreeBlocks)) <= remaining_blocks) {
+            // If there is enough memory left for header FreeBlocks, then we are creating new FreeBlocks element, it takes the place of fb in the tree (the order by addresses stays the same).
+            FreeBlocks* new_fb = (FreeBlocks*)((uint64)fb + n_blocks * MEM_BLOCK_SIZE);
+            new_fb->n_blocks = remaining_blocks;
+            this->tree_replace(fb, new_fb);
+            this->rebalance(new_fb);
+
+            // The remainder now belongs to (most likely) different bin.
+            this->put_in_bin(new_fb);
+        }
+        else {
+            // If there is not enough free blocks, we are removing the FreeBlocks element from the tree.
+            this->tree_remove(fb);
+        }
+    }
+
+    void* MemoryAllocator::take_blocks(FreeBlocks* fb, blocks_t n_blocks) {
+        // Take the first n_blocks of the FreeBlocks element for a new memory allocation.
+        this->split_front(fb, n_blocks);
+
+        // Mark the first and the last block of this memory allocation in the bitmaps, and return the free memory location.
+        blocks_t idx = ((uint64)fb - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE;
+        blocks_t last_idx = idx + n_blocks - 1;
+        this->extend_maps(last_idx);
+        this->start_map[idx / 64] |= (1UL << (idx % 64));
+        this->end_map[last_idx / 64] |= (1UL << (last_idx % 64));
+        this->used_blocks += n_blocks;
+        return (void*)fb;
+    }
+
+    void* MemoryAllocator::alloc(blocks_t n_blocks) {
+        // Request for no blocks is not an allocation that has failed, so it is not counted as one.
+        if (n_blocks == 0) {
+            return nullptr;
+        }
+
+        // Find exactly n free blocks, or at least more than n, Best-Fit algorithm, with help of segregated bins.
+        FreeBlocks* best = this->find_best_fit(n_blocks);
+        if (best) {
+            return this->count_alloc(this->take_blocks(best, n_blocks));
         }
 
         // If we failed to find at least n free blocks or more, we return nullptr.
-        return nullptr;
+        return this->count_alloc(nullptr);
     }
 
-    int MemoryAllocator::free(void* address) {
+    void* MemoryAllocator::alloc_aligned(blocks_t n_blocks, blocks_t align_blocks) {
+        // The alignment has to be a power of two number of blocks, every allocation is already aligned to one block.
+        if (n_blocks == 0 || align_blocks == 0 || (align_blocks & (align_blocks - 1)) != 0) {
+            return nullptr;
+        }
+
+        // Any element with n_blocks + align_blocks - 1 blocks has an aligned address somewhere in its first align_blocks blocks, and n_blocks after it.
+        FreeBlocks* best = this->find_best_fit(n_blocks + align_blocks - 1);
+        if (!best) {
+            return this->count_alloc(nullptr);
+        }
+
+        uint64 align_bytes = align_blocks * MEM_BLOCK_SIZE;
+        blocks_t lead_blocks = ((align_bytes - (uint64)best % align_bytes) % align_bytes) / MEM_BLOCK_SIZE;
+        if (lead_blocks > 0) {
+            // Blocks before the aligned address stay free, as their own (smaller) FreeBlocks element that keeps its place in the tree, and the rest becomes new element right after it.
+            this->take_from_bin(best);
+
+            FreeBlocks* aligned_fb = (FreeBlocks*)((uint64)best + lead_blocks * MEM_BLOCK_SIZE);
+            aligned_fb->n_blocks = best->n_blocks - lead_blocks;
+            best->n_blocks = lead_blocks;
+
+            this->tree_insert(aligned_fb);
+            this->rebalance(best);
+            this->put_in_bin(best);
+            this->put_in_bin(aligned_fb);
+            best = aligned_fb;
+        }
+
+        return this->count_alloc(this->take_blocks(best, n_blocks));
+    }
+
+    int MemoryAllocator::check_address(void* address, blocks_t* idx) {
         if (!address) {
             return ADDRESS_IS_NULL;
         }
@@ -109,68 +521,204 @@ namespace Kernel {
             return ADDRESS_IS_NOT_ALIGNED;
         }
 
-        blocks_t n_blocks = this->alloc_table[((uint64)address - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE];
-        if (n_blocks == 0) {
-            // If the address does not use any blocks in the allocation table, then it wasn't allocated by the kernel.
+        if ((uint64)address < (uint64)HEAP_START_ADDR || ((uint64)address - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE >= this->total_blocks) {
+            // If the address is not in the heap, it for sure wasn't allocated by the kernel.
             return ADDRESS_IS_NOT_USED;
         }
 
-        // Find the adequate place where we can place the new FreeBlock.
-        FreeBlocks* new_fb = (FreeBlocks*)address, *prev = nullptr;
-        for (FreeBlocks* curr_fb = this->fb_head; curr_fb && new_fb >= curr_fb; curr_fb = curr_fb->next) {
-            if (new_fb < (FreeBlocks*)((uint64)curr_fb + curr_fb->n_blocks * MEM_BLOCK_SIZE)) {
-                // In case the address belongs to the free part of the memory, then it for sure didn't come from the kernel.
-                return ADDRESS_IS_NOT_USED;
-            }
-            prev = curr_fb;
+        *idx = ((uint64)address - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE;
+        if (*idx / 64 >= this->valid_words || !(this->start_map[*idx / 64] & (1UL << (*idx % 64)))) {
+            // If the address is not the first block of some memory allocation (this includes the free blocks, and blocks above the high-water mark too), then it wasn't allocated by the kernel.
+            return ADDRESS_IS_NOT_USED;
         }
 
-        // Only after that, write at the address of used blocks, the number of free blocks.
-        new_fb->n_blocks = n_blocks;
+        return MEM_SUCCESS;
+    }
+
+    void MemoryAllocator::release_blocks(void* address, blocks_t n_blocks) {
+        // Find the free elements right before and right after the address, with one walk down the tree.
+        FreeBlocks* prev, *next;
+        this->find_neighbours(address, &prev, &next);
+
+        // Merge with the predecessor and/or the successor if they are adjacent. Elements that we merge with must leave their bins before their size changes.
+        // And the resulting element is put in the bin only once we know its final size.
+        bool merge_prev = prev && (uint64)prev + prev->n_blocks * MEM_BLOCK_SIZE == (uint64)address;
+        bool merge_next = next && (uint64)address + n_blocks * MEM_BLOCK_SIZE == (uint64)next;
 
-        // Chaining the freed blocks to the list of free blocks.
-        if (prev) {
-            new_fb->prev = prev;
-            new_fb->next = prev->next;
-            if (new_fb->next) {
-                new_fb->next->prev = new_fb;
+        FreeBlocks* new_fb;
+        if (merge_prev) {
+            // The predecessor grows over the freed blocks (and the successor), so its place in the tree stays the same, only the successor leaves the tree.
+            new_fb = prev;
+            this->take_from_bin(new_fb);
+            new_fb->n_blocks += n_blocks;
+
+            if (merge_next) {
+                this->take_from_bin(next);
+                this->tree_remove(next);
+                new_fb->n_blocks += next->n_blocks;
             }
-            prev->next = new_fb;
+            this->rebalance(new_fb);
+        }
+        else if (merge_next) {
+            // The freed blocks take over the successor, and its place in the tree, since nothing is between them.
+            new_fb = (FreeBlocks*)address;
+            this->take_from_bin(next);
+            new_fb->n_blocks = n_blocks + next->n_blocks;
+            this->tree_replace(next, new_fb);
+            this->rebalance(new_fb);
         }
         else {
-            new_fb->next = fb_head;
-            new_fb->prev = (FreeBlocks*)nullptr;
-            if (this->fb_head) {
-                this->fb_head->prev = new_fb;
-            }
-            this->fb_head = new_fb;
+            // Only after that, write at the address of used blocks, the number of free blocks.
+            new_fb = (FreeBlocks*)address;
+            new_fb->n_blocks = n_blocks;
+            this->tree_insert(new_fb);
         }
 
-        // We remember in the allocation table, that for this address we haven't allocated any blocks.
-        this->alloc_table[((uint64)address - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE] = 0;
+        this->put_in_bin(new_fb);
+    }
 
-        MemoryAllocator::merge_blocks(new_fb);
-        MemoryAllocator::merge_blocks(new_fb->prev);
+    int MemoryAllocator::free(void* address) {
+        blocks_t idx;
+        int result = this->check_address(address, &idx);
+        if (result != MEM_SUCCESS) {
+            return result;
+        }
+
+        // We remember in the bitmaps, that this memory allocation is no more.
+        blocks_t n_blocks = this->get_alloc_blocks(idx);
+        blocks_t last_idx = idx + n_blocks - 1;
+        this->start_map[idx / 64] &= ~(1UL << (idx % 64));
+        this->end_map[last_idx / 64] &= ~(1UL << (last_idx % 64));
+        this->used_blocks -= n_blocks;
+        this->n_frees++;
+
+        this->release_blocks(address, n_blocks);
         return MEM_SUCCESS;
     }
 
-    int MemoryAllocator::merge_blocks(FreeBlocks* fb) {
-        if (!fb) {
-            return ADDRESS_IS_NULL;
+    int MemoryAllocator::resize_in_place(void* address, blocks_t n_blocks, blocks_t* old_blocks) {
+        blocks_t idx;
+        int result = this->check_address(address, &idx);
+        if (result != MEM_SUCCESS) {
+            return result;
         }
 
-        if (fb->next && fb->next == (FreeBlocks*)((uint64)fb + fb->n_blocks * MEM_BLOCK_SIZE)) {
-            // In case fb has successor that starts immediatelly after this one ends, we can merge them.
-            fb->n_blocks += fb->next->n_blocks;
-            fb->next = fb->next->next;
+        *old_blocks = this->get_alloc_blocks(idx);
+        blocks_t old_last_idx = idx + *old_blocks - 1;
+        blocks_t new_last_idx = idx + n_blocks - 1;
 
-            if (fb->next) {
-                fb->next->prev = fb;
+        if (n_blocks > *old_blocks) {
+            // Growing is possible only if the free element that comes right after the allocation is big enough, then its first blocks become the tail of the allocation.
+            FreeBlocks* next = (FreeBlocks*)((uint64)address + *old_blocks * MEM_BLOCK_SIZE);
+            FreeBlocks* prev, *found_next;
+            this->find_neighbours((void*)next, &prev, &found_next);
+            if (found_next != next || next->n_blocks < n_blocks - *old_blocks) {
+                return MEM_FAILED;
             }
 
-            return MEM_SUCCESS;
+            this->split_front(next, n_blocks - *old_blocks);
+            this->extend_maps(new_last_idx);
+            this->used_blocks += n_blocks - *old_blocks;
         }
+        else if (n_blocks < *old_blocks) {
+            // Shrinking always succeeds, the tail of the allocation is freed (and merged with the following free element).
+            this->used_blocks -= *old_blocks - n_blocks;
+            this->release_blocks((void*)((uint64)address + n_blocks * MEM_BLOCK_SIZE), *old_blocks - n_blocks);
+        }
+
+        // The end tag of the allocation moves to its new last block.
+        this->end_map[old_last_idx / 64] &= ~(1UL << (old_last_idx % 64));
+        this->end_map[new_last_idx / 64] |= (1UL << (new_last_idx % 64));
+        return MEM_SUCCESS;
+    }
+
+    blocks_t MemoryAllocator::get_largest_free_extent() {
+        // Root of the tree knows the biggest element in the whole tree.
+        return MemoryAllocator::get_max_blocks(this->fb_root);
+    }
+}
+
+#endif
+
+namespace Kernel {
+    // Functions that are the same for both of the backends of the kernel heap.
+    void* MemoryAllocator::count_alloc(void* address) {
+        // Every valid alloc goes through here with its result, so that the counters are updated at one place. Invalid requests (no blocks, or bad alignment) don't, the heap hasn't failed them.
+        if (address) {
+            this->n_allocs++;
+        }
+        else {
+            this->n_failed_allocs++;
+        }
+        return address;
+    }
+
+    void* MemoryAllocator::realloc(void* address, blocks_t n_blocks) {
+        // Without the old allocation, this is just an alloc, and with no blocks, this is just a free.
+        if (!address) {
+            return this->alloc(n_blocks);
+        }
+
+        if (n_blocks == 0) {
+            this->free(address);
+            return nullptr;
+        }
+
+        blocks_t old_blocks;
+        int result = this->resize_in_place(address, n_blocks, &old_blocks);
+        if (result == MEM_SUCCESS) {
+            return address;
+        }
+        else if (result != MEM_FAILED) {
+            // The address wasn't allocated by the kernel.
+            return nullptr;
+        }
+
+        // Only if the allocation can't grow in place, move it, in case that fails as well, the old allocation stays as it was.
+        uint64* new_address = (uint64*)this->alloc(n_blocks);
+        if (!new_address) {
+            return nullptr;
+        }
+
+        uint64 n_words = (uint64)((old_blocks < n_blocks) ? old_blocks : n_blocks) * MEM_BLOCK_SIZE / sizeof(uint64);
+        for (uint64 i = 0; i < n_words; ++i) {
+            new_address[i] = ((uint64*)address)[i];
+        }
+
+        this->free(address);
+        return (void*)new_address;
+    }
+
+    blocks_t MemoryAllocator::get_total_blocks() {
+        return this->total_blocks;
+    }
+
+    blocks_t MemoryAllocator::get_used_blocks() {
+        return this->used_blocks;
+    }
+
+    uint64 MemoryAllocator::get_free_extent_count() {
+        return this->n_free_extents;
+    }
+
+    uint64 MemoryAllocator::get_fragmentation_index() {
+        // Percent of the free memory that is outside of the largest free extent. It is 0 when all of the free memory is in one piece (or there is none), and goes to 100 as it is split into more and more small pieces.
+        blocks_t free_blocks = this->total_blocks - this->used_blocks;
+        if (free_blocks == 0) {
+            return 0;
+        }
+        return 100 - (uint64)this->get_largest_free_extent() * 100 / free_blocks;
+    }
+
+    uint64 MemoryAllocator::get_alloc_count() {
+        return this->n_allocs;
+    }
+
+    uint64 MemoryAllocator::get_free_count() {
+        return this->n_frees;
+    }
 
-        return MEM_FAILED;
+    uint64 MemoryAllocator::get_failed_alloc_count() {
+        return this->n_failed_allocs;
     }
 }
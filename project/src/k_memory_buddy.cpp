@@ -0,0 +1,231 @@
+#include "k_memory.hpp"
+#include "k_utils.hpp"
+
+#if MEM_BUDDY_ALLOCATOR == 1
+
+namespace Kernel {
+    MemoryAllocator::MemoryAllocator() {
+        // Every block needs one byte in the order table, so at most this many blocks fit: N * MEM_BLOCK_SIZE + N = (END_ADDR - START_ADDR + 1).
+        blocks_t max_blocks = ((uint64)HEAP_END_ADDR - (uint64)HEAP_START_ADDR + 1) / (MEM_BLOCK_SIZE + 1);
+
+        // Initialize the order table with zeroes, no block is the first block of some element yet.
+        this->order_table = (uint8*)HEAP_START_ADDR;
+        for (blocks_t i = 0; i < max_blocks; ++i) {
+            this->order_table[i] = 0;
+        }
+
+        // HEAP_START is now moved after the table, and aligned, so that the elements of the buddy system are aligned in absolute addresses too.
+        uint64 heap_start = ((uint64)HEAP_START_ADDR + max_blocks + (HEAP_ALIGNMENT - 1)) & ~(HEAP_ALIGNMENT - 1);
+        HEAP_START_ADDR = (void*)heap_start;
+        this->total_blocks = ((uint64)HEAP_END_ADDR + 1 - heap_start) / MEM_BLOCK_SIZE;
+
+        this->used_blocks = 0;
+        this->n_free_extents = 0;
+        this->n_allocs = 0;
+        this->n_frees = 0;
+        this->n_failed_allocs = 0;
+
+        for (int i = 0; i < MAX_ORDERS; ++i) {
+            this->free_lists[i] = (FreeBlocks*)nullptr;
+        }
+        this->orders_map = 0;
+
+        // The heap is most likely not a power of two blocks big, so split it into the biggest elements that are aligned to their size and fit in the heap.
+        blocks_t idx = 0;
+        while (idx < this->total_blocks) {
+            int order = MAX_ORDERS - 1;
+            while (order > 0 && ((idx & ((1U << order) - 1)) != 0 || (uint64)idx + (1UL << order) > this->total_blocks)) {
+                order--;
+            }
+
+            this->push_free(idx, order);
+            idx += (1U << order);
+        }
+    }
+
+    MemoryAllocator& MemoryAllocator::get_instance() {
+        static MemoryAllocator mem_allocator;
+        return mem_allocator;
+    }
+
+    void MemoryAllocator::push_free(blocks_t idx, int order) {
+        // Chain the element that starts at block idx as the new head of the free list of its order, and mark it as free in the order table.
+        FreeBlocks* fb = (FreeBlocks*)((uint64)HEAP_START_ADDR + (uint64)idx * MEM_BLOCK_SIZE);
+        fb->prev = (FreeBlocks*)nullptr;
+        fb->next = this->free_lists[order];
+        if (fb->next) {
+            fb->next->prev = fb;
+        }
+
+        this->free_lists[order] = fb;
+        this->orders_map |= (1UL << order);
+        this->order_table[idx] = FREE_FLAG | order;
+        this->n_free_extents++;
+    }
+
+    void MemoryAllocator::unlink_free(blocks_t idx, int order) {
+        // Unchain the free element that starts at block idx from the free list of its order, its first block is no longer marked as free.
+        FreeBlocks* fb = (FreeBlocks*)((uint64)HEAP_START_ADDR + (uint64)idx * MEM_BLOCK_SIZE);
+        if (fb->prev) {
+            fb->prev->next = fb->next;
+        }
+        else {
+            this->free_lists[order] = fb->next;
+        }
+
+        if (fb->next) {
+            fb->next->prev = fb->prev;
+        }
+
+        if (!this->free_lists[order]) {
+            this->orders_map &= ~(1UL << order);
+        }
+        this->order_table[idx] = 0;
+        this->n_free_extents--;
+    }
+
+    void* MemoryAllocator::alloc_order(int order) {
+        if (order >= MAX_ORDERS) {
+            return nullptr;
+        }
+
+        // Take the first non empty free list of at least this order, its first element is the one we will split.
+        int found_order = Utils::find_first_set(this->orders_map & (~0UL << order));
+        if (found_order < 0) {
+            return nullptr;
+        }
+
+        blocks_t idx = ((uint64)this->free_lists[found_order] - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE;
+        this->unlink_free(idx, found_order);
+
+        // Split the element in halves until we get to the wanted order, every upper half (buddy of the lower half) becomes free element of one order lower.
+        while (found_order > order) {
+            found_order--;
+            this->push_free(idx + (1U << found_order), found_order);
+        }
+
+        this->order_table[idx] = USED_FLAG | order;
+        this->used_blocks += (1U << order);
+        return (void*)((uint64)HEAP_START_ADDR + (uint64)idx * MEM_BLOCK_SIZE);
+    }
+
+    void* MemoryAllocator::alloc(blocks_t n_blocks) {
+        // Request for no blocks is not an allocation that has failed, so it is not counted as one.
+        if (n_blocks == 0) {
+            return nullptr;
+        }
+
+        // Round the number of blocks up to the power of two.
+        return this->count_alloc(this->alloc_order(Utils::ceil_log2(n_blocks)));
+    }
+
+    void* MemoryAllocator::alloc_aligned(blocks_t n_blocks, blocks_t align_blocks) {
+        // The alignment has to be a power of two number of blocks, and at most the alignment of the heap start.
+        if (n_blocks == 0 || align_blocks == 0 || (align_blocks & (align_blocks - 1)) != 0 || align_blocks * MEM_BLOCK_SIZE > HEAP_ALIGNMENT) {
+            return nullptr;
+        }
+
+        // Every element is aligned to its own size, so it is enough to allocate an element that is at least as big as the alignment.
+        int order = Utils::ceil_log2(n_blocks);
+        int align_order = Utils::floor_log2(align_blocks);
+        return this->count_alloc(this->alloc_order(order > align_order ? order : align_order));
+    }
+
+    int MemoryAllocator::free(void* address) {
+        if (!address) {
+            return ADDRESS_IS_NULL;
+        }
+
+        if ((uint64)address % MEM_BLOCK_SIZE != 0) {
+            // If the address is not alligned to the block size, it for sure wasn't allocated by the kernel.
+            return ADDRESS_IS_NOT_ALIGNED;
+        }
+
+        if ((uint64)address < (uint64)HEAP_START_ADDR || ((uint64)address - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE >= this->total_blocks) {
+            return ADDRESS_IS_NOT_USED;
+        }
+
+        blocks_t idx = ((uint64)address - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE;
+        if (!(this->order_table[idx] & USED_FLAG)) {
+            // If the address is not the first block of some used element, then it wasn't allocated by the kernel.
+            return ADDRESS_IS_NOT_USED;
+        }
+
+        int order = this->order_table[idx] & ORDER_MASK;
+        this->order_table[idx] = 0;
+        this->used_blocks -= (1U << order);
+        this->n_frees++;
+
+        // As long as the buddy is a free element of the same order, merge with it. Buddy is found by flipping the bit of the order, and checked with one look at the table.
+        while (order < MAX_ORDERS - 1) {
+            blocks_t buddy_idx = idx ^ (1U << order);
+            if ((uint64)buddy_idx + (1UL << order) > this->total_blocks || this->order_table[buddy_idx] != (FREE_FLAG | order)) {
+                break;
+            }
+
+            this->unlink_free(buddy_idx, order);
+            idx = (idx < buddy_idx) ? idx : buddy_idx;
+            order++;
+        }
+
+        this->push_free(idx, order);
+        return MEM_SUCCESS;
+    }
+
+    int MemoryAllocator::resize_in_place(void* address, blocks_t n_blocks, blocks_t* old_blocks) {
+        if (!address) {
+            return ADDRESS_IS_NULL;
+        }
+
+        if ((uint64)address % MEM_BLOCK_SIZE != 0) {
+            return ADDRESS_IS_NOT_ALIGNED;
+        }
+
+        if ((uint64)address < (uint64)HEAP_START_ADDR || ((uint64)address - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE >= this->total_blocks) {
+            return ADDRESS_IS_NOT_USED;
+        }
+
+        blocks_t idx = ((uint64)address - (uint64)HEAP_START_ADDR) / MEM_BLOCK_SIZE;
+        if (!(this->order_table[idx] & USED_FLAG)) {
+            return ADDRESS_IS_NOT_USED;
+        }
+
+        int order = this->order_table[idx] & ORDER_MASK;
+        int new_order = Utils::ceil_log2(n_blocks);
+        *old_blocks = (1U << order);
+
+        if (new_order > order) {
+            // Element can grow in place only if it is the lower half of every bigger element up to the new order, and all the upper halves (buddies) are free elements.
+            if (new_order >= MAX_ORDERS || (idx & ((1U << new_order) - 1)) != 0 || (uint64)idx + (1UL << new_order) > this->total_blocks) {
+                return MEM_FAILED;
+            }
+
+            for (int k = order; k < new_order; ++k) {
+                if (this->order_table[idx + (1U << k)] != (FREE_FLAG | k)) {
+                    return MEM_FAILED;
+                }
+            }
+
+            for (int k = order; k < new_order; ++k) {
+                this->unlink_free(idx + (1U << k), k);
+            }
+        }
+        else {
+            // Shrinking always succeeds, upper halves are split off as free elements. Their buddies are the lower halves that are still used, so there is nothing to merge them with.
+            for (int k = order - 1; k >= new_order; --k) {
+                this->push_free(idx + (1U << k), k);
+            }
+        }
+
+        this->used_blocks = this->used_blocks - (1U << order) + (1U << new_order);
+        this->order_table[idx] = USED_FLAG | new_order;
+        return MEM_SUCCESS;
+    }
+
+    blocks_t MemoryAllocator::get_largest_free_extent() {
+        // The biggest free element is in the highest non empty free list.
+        return this->orders_map ? (1U << Utils::floor_log2(this->orders_map)) : 0;
+    }
+}
+
+#endif
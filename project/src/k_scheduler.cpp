@@ -1,20 +1,47 @@
 #include "k_scheduler.hpp"
-#include "k_trap_handlers.hpp"
+#include "k_timer.hpp"
+#include "k_memory.hpp"
 #include "syscall_c.hpp"
+#include "k_utils.hpp"
 
 namespace Kernel {
-    static void flush_putc_loop(void* args) {
+    static void idle_loop(void* args) {
+        // Idle thread of the hart runs only when there are no ready threads for the hart, not even ones to steal. It checks without the kernel lock whether that has changed, so that it doesn't keep the other harts out of the kernel.
+        // Otherwise the hart waits for an interrupt (with the interrupts enabled), so that it doesn't burn the CPU. The hart is woken up by its next timer tick at the latest.
+        Scheduler& scheduler = Scheduler::get_instance();
         while (true) {
-            // This is used by internal thread, that will flush characters to the console, it always tries to execute thread_dispatch, so that other threads can run.
-            Kernel::flush_putc_buffer();
-            thread_dispatch();
+            if (scheduler.has_ready_tcbs((uint64)args)) {
+                thread_dispatch();
+            }
+            else {
+                __asm__ volatile ("wfi");
+            }
         }
     }
 
     void Scheduler::initialize() {
-        if (!this->flush_tcb) {
-            // Create internal thread for flushing putc console buffer.
-            thread_create((thread_t*)&this->flush_tcb, flush_putc_loop, nullptr);
+        if (!this->default_time_slice) {
+            this->default_time_slice = DEFAULT_TIME_SLICE;
+        }
+
+        for (uint64 hart_id = 0; hart_id < MAX_HARTS; ++hart_id) {
+            Hart& hart = harts[hart_id];
+            if (hart.idle_tcb) {
+                continue;
+            }
+
+            // Every hart gets its own idle thread, which never goes to the run queues. It runs in the supervisor mode, as it reads the scheduler directly.
+            uint64* stack_space = (uint64*)MemoryAllocator::get_instance().alloc(Utils::to_blocks(DEFAULT_STACK_SIZE));
+            hart.idle_tcb = create_tcb(idle_loop, (void*)hart_id, stack_space ? &stack_space[DEFAULT_STACK_SIZE / sizeof(uint64)] : nullptr);
+            hart.idle_tcb->context.sstatus |= (1 << 8);
+            hart.idle_tcb->hart = hart_id;
+            hart.idle_tcb->affinity = 1UL << hart_id;
+            hart.idle_tcb->priority = N_PRIORITIES - 1;
+            hart.idle_tcb->time_slice = UNBOUNDED_TIME_SLICE;
+            hart.id = hart_id;
+
+            // Hart 0 is the one that is running the main thread, the other harts start with their idle threads.
+            hart.current_tcb = (hart_id == 0) ? &main_tcb : hart.idle_tcb;
         }
     }
 
@@ -23,14 +50,506 @@ namespace Kernel {
         return scheduler;
     }
 
+    time_t Scheduler::get_level_slice(TCB* tcb, int level) {
+        // Top level has the time slice of the thread, or the default one if the thread doesn't have its own, and every level below it has twice as long time slice as the one above it.
+        time_t time_slice = tcb->own_time_slice ? tcb->own_time_slice : this->default_time_slice;
+        if (time_slice > (UNBOUNDED_TIME_SLICE >> level)) {
+            // Doubling such a long time slice would overflow, and it is practically unbounded anyway.
+            return UNBOUNDED_TIME_SLICE;
+        }
+        return time_slice << level;
+    }
+
+    int Scheduler::get_queue_index(TCB* tcb) {
+        return tcb->priority * MLFQ_LEVELS + tcb->level;
+    }
+
+    bool Scheduler::is_idle(TCB* tcb) {
+        return tcb == harts[tcb->hart].idle_tcb;
+    }
+
+    bool Scheduler::can_run_on(TCB* tcb, uint64 hart_id) {
+        return (tcb->affinity >> hart_id) & 1;
+    }
+
+    bool Scheduler::is_real_time(TCB* tcb) {
+        return tcb->rt_period != 0;
+    }
+
+    bool Scheduler::should_preempt(TCB* tcb, TCB* running_tcb) {
+        if (!running_tcb || running_tcb == tcb) {
+            return false;
+        }
+
+        // Idle thread always gives way. Real-time thread preempts every best effort thread, and real-time threads with later deadlines. Best effort threads preempt only best effort threads of lower priority.
+        if (is_idle(running_tcb)) {
+            return true;
+        }
+        if (is_real_time(tcb)) {
+            return !is_real_time(running_tcb) || tcb->rt_abs_deadline < running_tcb->rt_abs_deadline;
+        }
+        return !is_real_time(running_tcb) && tcb->priority < running_tcb->priority;
+    }
+
+    uint64 Scheduler::get_rt_utilization(time_t wcet, time_t deadline) {
+        // Rounded up, so that rounding never lets in a thread that wouldn't fit.
+        return (wcet * RT_CAPACITY + deadline - 1) / deadline;
+    }
+
+    uint64 Scheduler::get_load(uint64 hart_id) {
+        // Load of the hart is the number of its ready threads, plus the one it is running (if that is not its idle thread).
+        return this->run_queues[hart_id].n_ready + (is_idle(harts[hart_id].current_tcb) ? 0 : 1);
+    }
+
+    uint64 Scheduler::get_least_loaded_hart(uint64 first_hart, uint64 affinity) {
+        // Search starts from the given hart and goes around, so that the given hart wins the ties, and after it the harts that come right after it. Harts that are not in the affinity mask are skipped.
+        uint64 best_hart = first_hart, best_load = ~0UL;
+        for (uint64 i = 0; i < MAX_HARTS; ++i) {
+            uint64 hart_id = (first_hart + i) % MAX_HARTS;
+            uint64 load = this->get_load(hart_id);
+            if (((affinity >> hart_id) & 1) && load < best_load) {
+                best_hart = hart_id;
+                best_load = load;
+            }
+        }
+        return best_hart;
+    }
+
+    uint64 Scheduler::get_wake_hart(TCB* tcb) {
+        // Woken thread goes back to the hart it ran on last, as its data is most likely still in the cache of that hart, unless that hart is busy while the nearest other hart has nothing to do.
+        // Real-time thread always goes back to the hart that admitted it, as the capacity for it is reserved there. Thread whose last hart is no longer in its affinity mask has to move.
+        if (is_real_time(tcb)) {
+            return tcb->rt_hart;
+        }
+
+        uint64 hart_id = this->get_least_loaded_hart(tcb->hart, tcb->affinity);
+        if (hart_id != tcb->hart && (this->get_load(hart_id) == 0 || !can_run_on(tcb, tcb->hart))) {
+            this->run_queues[hart_id].n_migrations++;
+            return hart_id;
+        }
+        return tcb->hart;
+    }
+
+    void Scheduler::count_ready(RunQueue& run_queue, TCB* tcb, int delta) {
+        // Every hart in the affinity mask of the thread could steal it, except for real-time threads, which are never stolen.
+        run_queue.n_ready += delta;
+        if (is_real_time(tcb)) {
+            return;
+        }
+
+        for (uint64 affinity = tcb->affinity; affinity; affinity &= affinity - 1) {
+            run_queue.n_stealable[Utils::find_first_set(affinity)] += delta;
+        }
+    }
+
+    void Scheduler::enqueue(TCB* tcb) {
+        RunQueue& run_queue = this->run_queues[tcb->hart];
+        this->count_ready(run_queue, tcb, 1);
+        if (is_real_time(tcb)) {
+            // Real-time queue is kept ordered by the absolute deadlines, thread goes after the ones with the same deadline, so that they take turns.
+            TCB* next = run_queue.rt_queue.peek_first();
+            while (next && next->rt_abs_deadline <= tcb->rt_abs_deadline) {
+                next = next->next;
+            }
+            run_queue.rt_queue.add_before(tcb, next);
+            return;
+        }
+
+        int idx = get_queue_index(tcb);
+        run_queue.queues[idx].add_last(tcb);
+        run_queue.ready_map |= (1UL << idx);
+    }
+
+    void Scheduler::dequeue(TCB* tcb) {
+        RunQueue& run_queue = this->run_queues[tcb->hart];
+        this->count_ready(run_queue, tcb, -1);
+        if (is_real_time(tcb)) {
+            run_queue.rt_queue.remove(tcb);
+            return;
+        }
+
+        int idx = get_queue_index(tcb);
+        run_queue.queues[idx].remove(tcb);
+        if (run_queue.queues[idx].is_empty()) {
+            run_queue.ready_map &= ~(1UL << idx);
+        }
+    }
+
+    TCB* Scheduler::steal_tcb(uint64 hart_id) {
+        // Victim is the hart with the most ready threads that this hart could take, search starts from the hart after this one, so that the harts don't all go after the same victim. Real-time threads are never stolen.
+        uint64 victim_id = hart_id, victim_ready = 0;
+        for (uint64 i = 1; i < MAX_HARTS; ++i) {
+            uint64 other_id = (hart_id + i) % MAX_HARTS;
+            uint64 other_ready = this->run_queues[other_id].n_stealable[hart_id];
+            if (other_ready > victim_ready) {
+                victim_id = other_id;
+                victim_ready = other_ready;
+            }
+        }
+
+        if (!victim_ready) {
+            return nullptr;
+        }
+
+        // Take the last thread that may run on this hart from the most important queue of the victim that has one, that is the one that the victim would run the last among the threads of that priority and level.
+        // There is such a thread, as the victim has counted it, in most cases it is the very last one of the first queue.
+        RunQueue& victim_queue = this->run_queues[victim_id];
+        TCB* tcb = nullptr;
+        for (uint64 ready_map = victim_queue.ready_map; !tcb; ready_map &= ready_map - 1) {
+            tcb = victim_queue.queues[Utils::find_first_set(ready_map)].peek_last();
+            while (tcb && !can_run_on(tcb, hart_id)) {
+                tcb = tcb->prev;
+            }
+        }
+        this->dequeue(tcb);
+
+        tcb->hart = hart_id;
+        this->run_queues[hart_id].n_steals++;
+        this->run_queues[hart_id].n_migrations++;
+        return tcb;
+    }
+
     TCB* Scheduler::next_tcb() {
-        return this->queue.take_first();
+        // Take the real-time thread with the earliest deadline, if there is none, take the first thread from the queue of the highest priority and the highest level that has any ready threads on this hart.
+        // If there are none, try to steal one from another hart, and only if there is nothing to steal, run the idle thread.
+        Hart& hart = get_hart();
+        RunQueue& run_queue = this->run_queues[hart.id];
+        if (!run_queue.rt_queue.is_empty()) {
+            TCB* tcb = run_queue.rt_queue.take_first();
+            this->count_ready(run_queue, tcb, -1);
+            return tcb;
+        }
+
+        int idx = Utils::find_first_set(run_queue.ready_map);
+        if (idx < 0) {
+            TCB* stolen_tcb = this->steal_tcb(hart.id);
+            if (stolen_tcb) {
+                return stolen_tcb;
+            }
+
+            // Idle thread isn't preempted by the timer, it gives up the hart on its own once there is something to run.
+            hart.idle_tcb->time_slice = UNBOUNDED_TIME_SLICE;
+            return hart.idle_tcb;
+        }
+
+        TCB* tcb = run_queue.queues[idx].take_first();
+        if (run_queue.queues[idx].is_empty()) {
+            run_queue.ready_map &= ~(1UL << idx);
+        }
+        this->count_ready(run_queue, tcb, -1);
+        return tcb;
     }
 
     void Scheduler::put_tcb(TCB* tcb) {
-        if (tcb) {
+        if (tcb && !is_idle(tcb)) {
+            if (is_real_time(tcb)) {
+                // Real-time thread runs until it waits for its next period, blocks, a thread with an earlier deadline comes, or its job uses up its WCET, which is all the capacity reserved for it.
+                // Job that has used it up is cut off there, so that it can't take the capacity of the other real-time threads, its thread waits for the next period, and the job counts as missed.
+                if (tcb->status == TCBStatus::RUNNING) {
+                    tcb->used_ticks += get_hart().timer_ticks;
+                    if (tcb->used_ticks >= tcb->rt_wcet) {
+                        time_t release_ticks = this->end_real_time_job(tcb, true);
+                        if (release_ticks > 0) {
+                            Timer::get_instance().put_to_sleep(tcb, release_ticks);
+                            return;
+                        }
+                    }
+                }
+
+                // It goes back to the hart that admitted it, with the rest of the WCET of its job as its time slice.
+                tcb->hart = this->get_wake_hart(tcb);
+                tcb->time_slice = tcb->rt_wcet - tcb->used_ticks;
+            }
+            else if (tcb->status == TCBStatus::RUNNING) {
+                // Thread that was running is put back either because its time slice has expired, or because it gave up the CPU on its own, timer_ticks of this hart are still the ones it used.
+                // Its ticks are summed up across the level, so that a thread that yields right before its time slice expires can't stay on the top level forever.
+                tcb->used_ticks += get_hart().timer_ticks;
+                if (tcb->used_ticks >= this->get_level_slice(tcb, tcb->level)) {
+                    tcb->level = (tcb->level + 1 < MLFQ_LEVELS) ? tcb->level + 1 : tcb->level;
+                    tcb->used_ticks = 0;
+                }
+
+                // Its affinity mask may have been changed while it was running, in that case it leaves this hart.
+                if (!can_run_on(tcb, tcb->hart)) {
+                    tcb->hart = this->get_wake_hart(tcb);
+                }
+            }
+            else if (tcb->status == TCBStatus::SUSPENDED) {
+                // Thread that was blocked on a semaphore, or was sleeping, is most likely interactive, so it is moved one level up.
+                tcb->level = (tcb->level > 0) ? tcb->level - 1 : 0;
+                tcb->used_ticks = 0;
+                tcb->hart = this->get_wake_hart(tcb);
+            }
+            else if (tcb->status == TCBStatus::INITIALIZING) {
+                // New thread goes to the hart with the fewest threads (among the ones in its affinity mask), the threads that were running go back to the hart they ran on.
+                tcb->hart = this->get_least_loaded_hart(get_hart().id, tcb->affinity);
+            }
+
+            if (!is_real_time(tcb)) {
+                // Next time the thread runs, it will be preempted once it uses the rest of the time slice of its level.
+                tcb->time_slice = this->get_level_slice(tcb, tcb->level) - tcb->used_ticks;
+            }
             tcb->status = TCBStatus::READY;
-            this->queue.add_last(tcb);
+            this->enqueue(tcb);
+
+            TCB* running_tcb = harts[tcb->hart].current_tcb;
+            if (should_preempt(tcb, running_tcb)) {
+                // Thread that should run before the one running on its hart has become ready (or the hart is idle), so the running one is preempted, its hart gets the timer interrupt right away.
+                // Ticks are not periodic, so an idle hart wouldn't get one otherwise, and if this is the timer interrupt of that hart (thread was woken up from sleep), the handler switches the threads right away.
+                running_tcb->time_slice = 0;
+                Timer::get_instance().wake_hart(tcb->hart);
+            }
+        }
+    }
+
+    bool Scheduler::has_ready_tcbs(uint64 hart_id) {
+        // Counters are read atomically, so that the idle loop reads them again every time, instead of keeping them in a register. Only the threads that this hart could steal count on the other harts.
+        if (__atomic_load_n(&this->run_queues[hart_id].n_ready, __ATOMIC_RELAXED)) {
+            return true;
+        }
+
+        for (uint64 i = 1; i < MAX_HARTS; ++i) {
+            RunQueue& run_queue = this->run_queues[(hart_id + i) % MAX_HARTS];
+            if (__atomic_load_n(&run_queue.n_stealable[hart_id], __ATOMIC_RELAXED)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint64 Scheduler::get_steal_count() {
+        uint64 n_steals = 0;
+        for (uint64 hart_id = 0; hart_id < MAX_HARTS; ++hart_id) {
+            n_steals += this->run_queues[hart_id].n_steals;
+        }
+        return n_steals;
+    }
+
+    uint64 Scheduler::get_migration_count() {
+        uint64 n_migrations = 0;
+        for (uint64 hart_id = 0; hart_id < MAX_HARTS; ++hart_id) {
+            n_migrations += this->run_queues[hart_id].n_migrations;
+        }
+        return n_migrations;
+    }
+
+    int Scheduler::set_priority(TCB* tcb, int priority) {
+        if (!tcb || priority < 0 || priority >= N_PRIORITIES) {
+            return PRIORITY_INVALID;
+        }
+
+        if (tcb->status == TCBStatus::READY) {
+            // Ready thread has to be moved to the queue of its new priority.
+            this->dequeue(tcb);
+            tcb->priority = priority;
+            this->enqueue(tcb);
+        }
+        else {
+            tcb->priority = priority;
+        }
+
+        return PRIORITY_SUCCESS;
+    }
+
+    int Scheduler::set_real_time(TCB* tcb, time_t period, time_t deadline, time_t wcet) {
+        deadline = deadline ? deadline : period;
+        if (!tcb || (period && (wcet == 0 || wcet > deadline || deadline > period))) {
+            return RT_INVALID;
+        }
+        if (!period && !is_real_time(tcb)) {
+            return RT_SUCCESS;
+        }
+
+        // Capacity that the thread has with its old parameters is given back first, so that the thread can change them without being counted twice.
+        if (is_real_time(tcb)) {
+            this->run_queues[tcb->rt_hart].rt_utilization -= get_rt_utilization(tcb->rt_wcet, tcb->rt_deadline);
+        }
+
+        // Capacity is looked for first on the hart of the thread, and then on the harts that come after it, the first hart (in the affinity mask of the thread) on which it fits takes it.
+        uint64 hart_id = tcb->hart;
+        if (period) {
+            uint64 utilization = get_rt_utilization(wcet, deadline);
+            uint64 i = 0;
+            while (i < MAX_HARTS && (!can_run_on(tcb, (tcb->hart + i) % MAX_HARTS) || this->run_queues[(tcb->hart + i) % MAX_HARTS].rt_utilization + utilization > RT_CAPACITY)) {
+                i++;
+            }
+
+            if (i == MAX_HARTS) {
+                if (is_real_time(tcb)) {
+                    this->run_queues[tcb->rt_hart].rt_utilization += get_rt_utilization(tcb->rt_wcet, tcb->rt_deadline);
+                }
+                return RT_NOT_ADMITTED;
+            }
+
+            hart_id = (tcb->hart + i) % MAX_HARTS;
+            this->run_queues[hart_id].rt_utilization += utilization;
+        }
+
+        // Ready thread is moved to the queue of its new class, its first job (if it is a real-time thread now) is released right away.
+        bool is_ready = tcb->status == TCBStatus::READY;
+        if (is_ready) {
+            this->dequeue(tcb);
+        }
+
+        tcb->rt_period = period;
+        tcb->rt_deadline = deadline;
+        tcb->rt_wcet = wcet;
+        tcb->rt_hart = hart_id;
+        if (is_ready) {
+            tcb->hart = hart_id;
+        }
+        this->reset_used_ticks(tcb);
+        if (period) {
+            tcb->rt_release = Timer::get_instance().get_ticks();
+            tcb->rt_abs_deadline = tcb->rt_release + deadline;
+            tcb->time_slice = wcet;
+        }
+        else {
+            tcb->time_slice = this->get_level_slice(tcb, tcb->level);
+        }
+
+        if (is_ready) {
+            this->enqueue(tcb);
+        }
+        else if (tcb->status == TCBStatus::RUNNING) {
+            // Running thread keeps its hart until it is put back (the hart it runs on is known through it), so if it was admitted on another one, its time slice is ended, and it moves there.
+            // Either way, the timer of its hart is programmed for its old time slice, so it has to be programmed again.
+            if (tcb->hart != hart_id && period) {
+                tcb->time_slice = 0;
+            }
+            Timer::get_instance().wake_hart(tcb->hart);
+        }
+        return RT_SUCCESS;
+    }
+
+    void Scheduler::reset_used_ticks(TCB* tcb) {
+        // Ticks that the running thread has used on its hart so far (not counted to it yet) belong to its old job, or to its old class, so they are not counted against the new one.
+        tcb->used_ticks = 0;
+        if (tcb->status == TCBStatus::RUNNING) {
+            harts[tcb->hart].timer_ticks = 0;
+        }
+    }
+
+    time_t Scheduler::end_real_time_job(TCB* tcb, bool overrun) {
+        // Job that ends on the tick of its deadline or later has missed it, ticks are the finest time that we have. Job that was cut off at its WCET has missed it as well, its work is not done.
+        time_t now = Timer::get_instance().get_ticks();
+        if (overrun || now >= tcb->rt_abs_deadline) {
+            tcb->rt_misses++;
+        }
+        this->reset_used_ticks(tcb);
+
+        // If the job took longer than the whole period, the next job is released right away, instead of releasing all of the jobs it has missed one after another.
+        tcb->rt_release += tcb->rt_period;
+        if (tcb->rt_release < now) {
+            tcb->rt_release = now;
+        }
+        tcb->rt_abs_deadline = tcb->rt_release + tcb->rt_deadline;
+        return tcb->rt_release - now;
+    }
+
+    int Scheduler::set_affinity(TCB* tcb, uint64 affinity) {
+        affinity &= ALL_HARTS_MASK;
+        if (!tcb || !affinity || is_idle(tcb)) {
+            return AFFINITY_INVALID;
+        }
+
+        uint64 old_affinity = tcb->affinity;
+        if (is_real_time(tcb) && !((affinity >> tcb->rt_hart) & 1)) {
+            // Capacity of the real-time thread is reserved on its hart, so it has to be admitted on one of the new harts, or it keeps its old mask.
+            tcb->affinity = affinity;
+            if (this->set_real_time(tcb, tcb->rt_period, tcb->rt_deadline, tcb->rt_wcet) != RT_SUCCESS) {
+                tcb->affinity = old_affinity;
+                return AFFINITY_INVALID;
+            }
+        }
+        else if (tcb->status == TCBStatus::READY) {
+            // Ready thread is counted as stealable by the harts of its old mask, so it is taken out of its queue before the mask changes, and then put on a hart of the new mask.
+            this->dequeue(tcb);
+            tcb->affinity = affinity;
+            if (!can_run_on(tcb, tcb->hart)) {
+                tcb->hart = this->get_least_loaded_hart(tcb->hart, affinity);
+                this->run_queues[tcb->hart].n_migrations++;
+            }
+            this->enqueue(tcb);
+        }
+        else {
+            tcb->affinity = affinity;
+        }
+
+        if (tcb->status == TCBStatus::RUNNING && !can_run_on(tcb, tcb->hart)) {
+            // Running thread has to leave its hart, so its time slice is ended, and the scheduler moves it once it is put back.
+            tcb->time_slice = 0;
+            Timer::get_instance().wake_hart(tcb->hart);
+        }
+        else if (tcb->status == TCBStatus::READY && should_preempt(tcb, harts[tcb->hart].current_tcb)) {
+            harts[tcb->hart].current_tcb->time_slice = 0;
+            Timer::get_instance().wake_hart(tcb->hart);
+        }
+        return AFFINITY_SUCCESS;
+    }
+
+    int Scheduler::set_time_slice(TCB* tcb, time_t time_slice) {
+        if (is_real_time(tcb)) {
+            // Real-time thread is not sliced, it runs by its deadline, so its time slice can be changed only once it is an ordinary thread again.
+            return TIME_SLICE_INVALID;
+        }
+
+        // The thread gets the whole new time slice of its level, if it is running, the ticks it has already used are counted against it.
+        tcb->own_time_slice = time_slice;
+        tcb->used_ticks = 0;
+        tcb->time_slice = this->get_level_slice(tcb, tcb->level);
+
+        if (tcb->status == TCBStatus::RUNNING) {
+            // Timer of the hart is programmed for the old time slice (or not at all, if it was unbounded), so it has to be programmed again.
+            Timer::get_instance().wake_hart(tcb->hart);
+        }
+        return TIME_SLICE_SUCCESS;
+    }
+
+    int Scheduler::set_default_time_slice(time_t time_slice) {
+        if (time_slice == 0) {
+            return TIME_SLICE_INVALID;
+        }
+
+        // Threads pick up the new default time slice the next time they are put in the scheduler.
+        this->default_time_slice = time_slice;
+        return TIME_SLICE_SUCCESS;
+    }
+
+    void Scheduler::boost(uint64 hart_id) {
+        // For every priority, move the ready threads from all the lower levels to the end of the top level, and let the running thread start from the top level as well.
+        RunQueue& run_queue = this->run_queues[hart_id];
+        for (int idx = 0; idx < N_QUEUES; ++idx) {
+            if (idx % MLFQ_LEVELS == 0) {
+                continue;
+            }
+
+            while (!run_queue.queues[idx].is_empty()) {
+                TCB* tcb = run_queue.queues[idx].take_first();
+                this->count_ready(run_queue, tcb, -1);
+                tcb->level = 0;
+                tcb->used_ticks = 0;
+                tcb->time_slice = this->get_level_slice(tcb, 0);
+                this->enqueue(tcb);
+            }
+            run_queue.ready_map &= ~(1UL << idx);
+        }
+
+        // Real-time thread is not in the queues, and its used ticks are the ones of its job, which the boost has nothing to do with.
+        TCB* running_tcb = harts[hart_id].current_tcb;
+        if (running_tcb && !is_idle(running_tcb) && !is_real_time(running_tcb)) {
+            running_tcb->level = 0;
+            running_tcb->used_ticks = 0;
+        }
+    }
+
+    void Scheduler::timer_tick(time_t ticks) {
+        // Every hart boosts its own run queue, on its own timer ticks.
+        Hart& hart = get_hart();
+        this->run_queues[hart.id].boost_ticks += ticks;
+        if (this->run_queues[hart.id].boost_ticks >= BOOST_PERIOD) {
+            this->run_queues[hart.id].boost_ticks = 0;
+            this->boost(hart.id);
         }
     }
-}
\ No newline at end of file
+}
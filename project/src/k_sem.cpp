@@ -1,17 +1,19 @@
 #include "k_sem.hpp"
-#include "k_memory.hpp"
+#include "k_slab.hpp"
 #include "k_scheduler.hpp"
-#include "k_utils.hpp"
+#include "k_hart.hpp"
 
 namespace Kernel {
     Sem* Sem::create_sem(int value) {
-        Sem* new_sem = (Sem*)MemoryAllocator::get_instance().alloc(Utils::to_blocks(sizeof(Sem)));
-        new_sem->initialize(value);
+        Sem* new_sem = (Sem*)SlabCache::get_cache(SlabCache::SEM_CACHE)->alloc();
+        if (new_sem) {
+            new_sem->initialize(value);
+        }
         return new_sem;
     }
 
     int Sem::free_sem(Sem* sem) {
-        return MemoryAllocator::get_instance().free(sem);
+        return SlabCache::get_cache(SlabCache::SEM_CACHE)->free(sem);
     }
 
     void Sem::initialize(int value) {
@@ -21,13 +23,12 @@ namespace Kernel {
 
     void Sem::block() {
         // Take the current thread, let its status be suspended, and add it to the queue of suspended threads.
-        TCB* suspended_tcb = current_tcb;
+        TCB* suspended_tcb = get_current_tcb();
         suspended_tcb->status = TCBStatus::SUSPENDED;
         this->suspended_tcbs.add_last(suspended_tcb);
 
         // Take a new thread, and perform context switch.
-        current_tcb = Scheduler::get_instance().next_tcb();
-        yield(suspended_tcb, current_tcb);
+        yield(suspended_tcb, Scheduler::get_instance().next_tcb());
     }
 
     int Sem::wait() {
@@ -38,7 +39,7 @@ namespace Kernel {
             // If this value is now lesser than 0 (negative), block the current thread.
             this->block();
 
-            if (current_tcb->interrupted) {
+            if (get_current_tcb()->interrupted) {
                 // In case the context was switched to this function, and in case the tcb that is currently being run was interrupted from its waiting.
                 // Then the wait has failed, and so return that as status code.
                 return WAIT_FAIL;
@@ -48,13 +49,22 @@ namespace Kernel {
         return WAIT_SUCCESS;
     }
 
+    bool Sem::try_wait() {
+        if (this->value <= 0) {
+            return false;
+        }
+
+        this->value = this->value - 1;
+        return true;
+    }
+
     int Sem::unblock(bool wait_error) {
         // Take first thread from the suspended threads list.
         TCB* tcb = this->suspended_tcbs.take_first();
 
         if (tcb) {
             // If we truly found a thread to resume, then let its interrupted flag be true in case semaphore is closing, otherwise false.
-            // Regardless, add this TCB to the scheduling queue.
+            // Regardless, add this TCB to the scheduling queue, the scheduler puts it back on the hart it ran on last, or on a nearby idle hart if that one is busy.
             tcb->interrupted = wait_error;
             Scheduler::get_instance().put_tcb(tcb);
             return UNBLOCK_SUCCESS;
@@ -76,6 +86,18 @@ namespace Kernel {
         return SIGNAL_SUCCESS;
     }
 
+    int Sem::signal(int count) {
+        // Threads that wait on the semaphore are the ones that made its value negative, at most count of them are resumed, in the same order as they came.
+        int n_waiting = (this->value < 0) ? -this->value : 0;
+        this->value = this->value + count;
+
+        for (int i = 0; i < count && i < n_waiting; ++i) {
+            this->unblock(false);
+        }
+
+        return SIGNAL_SUCCESS;
+    }
+
     int Sem::close() {
         // Resume all the blocked threads, such that they all return WAIT_FAIL from their sem_wait, once all of them are resumed, return.
         while (this->unblock(true) == UNBLOCK_SUCCESS);
@@ -0,0 +1,199 @@
+#include "k_slab.hpp"
+#include "k_memory.hpp"
+#include "k_tcb.hpp"
+#include "k_utils.hpp"
+
+namespace Kernel {
+    // Objects start right after the header of the slab, which takes up one block, and they are kept 16B aligned (stack pointer in RISC-V has to be 16B aligned).
+    constexpr size_t SLAB_HEADER_SIZE = MEM_BLOCK_SIZE;
+    constexpr size_t OBJECT_ALIGNMENT = 16;
+
+    // Sizes of the slabs of each cache (powers of two). A slab can't hold more than 64 objects, as that is how many bits we have in its free_map.
+    constexpr size_t TCB_SLAB_SIZE   = 4096;
+    constexpr size_t SEM_SLAB_SIZE   = 2048;
+    constexpr size_t STACK_SLAB_SIZE = 16 * DEFAULT_STACK_SIZE;
+
+    SlabCache::SlabCache(size_t object_size, size_t slab_size) {
+        this->object_size = (object_size + (OBJECT_ALIGNMENT - 1)) / OBJECT_ALIGNMENT * OBJECT_ALIGNMENT;
+        this->slab_size = slab_size;
+        this->objects_per_slab = (slab_size - SLAB_HEADER_SIZE) / this->object_size;
+        if (this->objects_per_slab > 64) {
+            this->objects_per_slab = 64;
+        }
+
+        this->partial_slabs.initialize();
+        this->full_slabs.initialize();
+        this->empty_slab = nullptr;
+
+        this->n_slabs = 0;
+        this->n_used = 0;
+    }
+
+    SlabCache* SlabCache::get_cache(int cache_id) {
+        // The caches are created on the first use, each one with the geometry of the kernel object it holds.
+        static SlabCache caches[N_CACHES] = {
+            { sizeof(TCB), TCB_SLAB_SIZE },
+            { sizeof(Sem), SEM_SLAB_SIZE },
+            { DEFAULT_STACK_SIZE, STACK_SLAB_SIZE }
+        };
+
+        if (cache_id < 0 || cache_id >= N_CACHES) {
+            return nullptr;
+        }
+
+        return &caches[cache_id];
+    }
+
+    uint64 SlabCache::get_full_map() {
+        // Bitmap in which every object of the slab is free.
+        return (this->objects_per_slab == 64) ? ~0UL : ((1UL << this->objects_per_slab) - 1);
+    }
+
+    SlabCache::Slab* SlabCache::create_slab() {
+        // Take the slab from the heap, aligned to its size, this is the only moment when slab cache touches the general heap (besides releasing a slab).
+        blocks_t slab_blocks = Utils::to_blocks(this->slab_size);
+        Slab* slab = (Slab*)MemoryAllocator::get_instance().alloc_aligned(slab_blocks, slab_blocks);
+        if (!slab) {
+            return nullptr;
+        }
+
+        slab->next = nullptr;
+        slab->prev = nullptr;
+        slab->cache = this;
+        slab->free_map = this->get_full_map();
+        slab->n_used = 0;
+
+        this->n_slabs++;
+        return slab;
+    }
+
+    void* SlabCache::alloc() {
+        // Prefer partially used slabs, then the cached empty one, and only if there are none of them, take a new slab from the heap.
+        Slab* slab = this->partial_slabs.peek_first();
+        if (!slab) {
+            slab = this->empty_slab ? this->empty_slab : this->create_slab();
+            if (!slab) {
+                return nullptr;
+            }
+
+            this->empty_slab = nullptr;
+            this->partial_slabs.add_first(slab);
+        }
+
+        // Take the first free object of the slab, and mark it as used.
+        int idx = Utils::find_first_set(slab->free_map);
+        slab->free_map &= ~(1UL << idx);
+        slab->n_used++;
+        this->n_used++;
+
+        if (slab->free_map == 0) {
+            // In case this was the last free object in the slab, move the slab to the list of full slabs.
+            this->partial_slabs.remove(slab);
+            this->full_slabs.add_first(slab);
+        }
+
+        return (void*)((uint64)slab + SLAB_HEADER_SIZE + idx * this->object_size);
+    }
+
+    int SlabCache::find_object(void* object, Slab** slab, uint64* idx) {
+        if (!object) {
+            return MemoryAllocator::ADDRESS_IS_NULL;
+        }
+
+        // The slab header is at the start of the slab, which is aligned to its size.
+        *slab = (Slab*)((uint64)object & ~(uint64)(this->slab_size - 1));
+        uint64 offset = (uint64)object - (uint64)*slab;
+        if (offset < SLAB_HEADER_SIZE || (offset - SLAB_HEADER_SIZE) % this->object_size != 0) {
+            return MemoryAllocator::ADDRESS_IS_NOT_ALIGNED;
+        }
+
+        // Addresses come from system calls as well, so nothing is read from the slab before we know that it is in the heap and that it is one of the slabs of this cache.
+        // Slab that was given back to the heap is no longer in any of the lists, so its stale objects don't pass this check either.
+        if ((uint64)*slab < (uint64)HEAP_START_ADDR || (uint64)*slab + this->slab_size - 1 > (uint64)HEAP_END_ADDR || !this->owns_slab(*slab)) {
+            return MemoryAllocator::ADDRESS_IS_NOT_USED;
+        }
+
+        *idx = (offset - SLAB_HEADER_SIZE) / this->object_size;
+        if (*idx >= this->objects_per_slab || ((*slab)->free_map & (1UL << *idx))) {
+            // In case the object is past the last one in the slab, or it is already free, then the object wasn't allocated by this cache.
+            return MemoryAllocator::ADDRESS_IS_NOT_USED;
+        }
+        return MemoryAllocator::MEM_SUCCESS;
+    }
+
+    bool SlabCache::owns_slab(Slab* slab) {
+        // Only the pointers are compared, the candidate slab itself is never read. Walk is linear in the number of slabs of the cache, which stays small.
+        if (slab == this->empty_slab) {
+            return true;
+        }
+
+        for (Slab* curr = this->partial_slabs.peek_first(); curr; curr = curr->next) {
+            if (curr == slab) {
+                return true;
+            }
+        }
+
+        for (Slab* curr = this->full_slabs.peek_first(); curr; curr = curr->next) {
+            if (curr == slab) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool SlabCache::is_allocated(void* object) {
+        Slab* slab;
+        uint64 idx;
+        return this->find_object(object, &slab, &idx) == MemoryAllocator::MEM_SUCCESS;
+    }
+
+    int SlabCache::free(void* object) {
+        Slab* slab;
+        uint64 idx;
+        int result = this->find_object(object, &slab, &idx);
+        if (result != MemoryAllocator::MEM_SUCCESS) {
+            return result;
+        }
+
+        if (slab->free_map == 0) {
+            // The slab was full, now it has one free object.
+            this->full_slabs.remove(slab);
+            this->partial_slabs.add_first(slab);
+        }
+
+        slab->free_map |= (1UL << idx);
+        slab->n_used--;
+        this->n_used--;
+
+        if (slab->n_used == 0) {
+            // Keep one empty slab around, and give back to the heap any other, so that caches don't hold on to the memory they don't need.
+            this->partial_slabs.remove(slab);
+            if (!this->empty_slab) {
+                this->empty_slab = slab;
+            }
+            else {
+                slab->cache = nullptr;
+                MemoryAllocator::get_instance().free(slab);
+                this->n_slabs--;
+            }
+        }
+
+        return MemoryAllocator::MEM_SUCCESS;
+    }
+
+    size_t SlabCache::get_object_size() {
+        return this->object_size;
+    }
+
+    uint64 SlabCache::get_objects_per_slab() {
+        return this->objects_per_slab;
+    }
+
+    uint64 SlabCache::get_slab_count() {
+        return this->n_slabs;
+    }
+
+    uint64 SlabCache::get_used_count() {
+        return this->n_used;
+    }
+}
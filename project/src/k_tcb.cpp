@@ -1,25 +1,21 @@
 #include "k_tcb.hpp"
 #include "k_memory.hpp"
+#include "k_slab.hpp"
 #include "k_scheduler.hpp"
+#include "k_hart.hpp"
+#include "k_timer.hpp"
 #include "syscall_c.hpp"
 #include "k_utils.hpp"
 
 namespace Kernel {
     // Main thread of the kernel, statically allocated (that way HEAP_START_ADDR is moved implicitly).
-    TCB main_tcb { { 0 }, nullptr, nullptr, false, nullptr, 0, DEFAULT_TIME_SLICE, TCBStatus::RUNNING, nullptr, nullptr, nullptr, nullptr };
-
-    // Remember that the current context and current thread should point to the main thread and its context at the beginning.
-    TCB* current_tcb = &Kernel::main_tcb;
-    Context* k_current_context = &Kernel::main_tcb.context;
-
-    // Initally, 0 ticks have passed since the last context switch.
-    time_t volatile timer_ticks = 0;
+    TCB main_tcb { { 0 }, { 0 }, { { 0 }, 0 }, false, nullptr, nullptr, false, nullptr, 0, DEFAULT_TIME_SLICE, TCBStatus::RUNNING, 0, Scheduler::DEFAULT_PRIORITY, 0, 0, 0, ALL_HARTS_MASK, 0, 0, 0, 0, 0, 0, 0, nullptr, nullptr, nullptr, nullptr };
 
 
     TCB* create_tcb(void (*body)(void* args), void* args, uint64* stack_space) {
         if (body && stack_space) {
             // We will create a new thread, only if the function that should be executed is passed, and if stack for that function is passed as well.
-            TCB* new_tcb = (TCB*)MemoryAllocator::get_instance().alloc(Utils::to_blocks(sizeof(TCB)));
+            TCB* new_tcb = (TCB*)SlabCache::get_cache(SlabCache::TCB_CACHE)->alloc();
             if (!new_tcb) {
                 return nullptr;
             }
@@ -28,7 +24,21 @@ namespace Kernel {
             new_tcb->sleep_for = 0;
             new_tcb->time_slice = DEFAULT_TIME_SLICE;
             new_tcb->status = TCBStatus::INITIALIZING;
+            new_tcb->own_time_slice = 0;
+            new_tcb->priority = Scheduler::DEFAULT_PRIORITY;
+            new_tcb->level = 0;
+            new_tcb->used_ticks = 0;
+            new_tcb->hart = 0;
+            new_tcb->affinity = ALL_HARTS_MASK;
+            new_tcb->rt_period = 0;
+            new_tcb->rt_deadline = 0;
+            new_tcb->rt_wcet = 0;
+            new_tcb->rt_release = 0;
+            new_tcb->rt_abs_deadline = 0;
+            new_tcb->rt_misses = 0;
+            new_tcb->rt_hart = 0;
             new_tcb->interrupted = false;
+            new_tcb->fp_used = false;
             new_tcb->body = body;
             new_tcb->args = args;
             new_tcb->next = nullptr;
@@ -39,27 +49,30 @@ namespace Kernel {
             new_tcb->context.usr_sp = (uint64)stack_space;
 
             // Allocate the kernel stack and set it.
-            new_tcb->sys_stack = (uint64*)MemoryAllocator::get_instance().alloc(Utils::to_blocks(DEFAULT_STACK_SIZE));
+            new_tcb->sys_stack = (uint64*)SlabCache::get_cache(SlabCache::STACK_CACHE)->alloc();
             if (!new_tcb->sys_stack) {
                 free_tcb(new_tcb);
                 return nullptr;
             }
             
-            // Again, for the same reason why usr_sp is pointing to the &stack[last_index + 1], so will sys_sp.
+            // Again, for the same reason why usr_sp is pointing to the &stack[last_index + 1], so will sys_sp. The thread starts on the empty kernel stack as well.
             new_tcb->context.sys_sp = (uint64)&new_tcb->sys_stack[DEFAULT_STACK_SIZE / sizeof(uint64)];
+            new_tcb->switch_context.sp = new_tcb->context.sys_sp;
 
             // Set the thraed_pointer registry to 0 (because of plic functions from hw.h, they require that).
             new_tcb->context.tp = 0;
 
             // Set the initial sstatus, it is inherited from the parent thread, enable interrupts regardless of that.
             // We are setting SPIE (SuperVisor Previous Interrupt Enable) bit, 5th one, that way when we return from suprevisor trap, interrupts will be enabled.
+            // FP state of the parent is not inherited, FS is Off, so the new thread gets its own (zeroed) FP registers on its first FP instruction.
             __asm__ volatile ("csrr %0, sstatus" : "=r" (new_tcb->context.sstatus));
-            new_tcb->context.sstatus = new_tcb->context.sstatus | (1 << 5);
+            new_tcb->context.sstatus = (new_tcb->context.sstatus | (1 << 5)) & ~SSTATUS_FS;
 
-            // Write to the context where we are going back to after the first context restauration of this new thread.
-            // Which is code written in assembly, which redirects us to k_tcb_run_wrapper. We can't return directly to k_tcb_run_wrapper.
+            // Write to the switch context where we are going back to after the first context switch to this new thread.
+            // Which is code written in assembly, which leaves the kernel to k_tcb_run_wrapper (sepc of the thread). We can't return directly to k_tcb_run_wrapper.
             // As we will be doing context switch in kernel, so we are still in supervisor trap, so we have to execute sret at one point to leave that.
-            new_tcb->context.ra = (uint64)k_tcb_start;
+            new_tcb->switch_context.ra = (uint64)k_tcb_start;
+            new_tcb->context.sepc = (uint64)k_tcb_run_wrapper;
 
             // Create new semamphore for join operation.
             new_tcb->join_sem = Kernel::Sem::create_sem(0);
@@ -81,61 +94,103 @@ namespace Kernel {
             MemoryAllocator::get_instance().free((void*)((uint64)tcb->usr_stack - DEFAULT_STACK_SIZE));
             tcb->usr_stack = nullptr;
 
-            // Unlinke usr_stack, sys_stack points to &stack[0], as we allocated it in kernel.
-            MemoryAllocator::get_instance().free((void*)tcb->sys_stack);
+            // Unlinke usr_stack, sys_stack points to &stack[0], as we allocated it in kernel (from the cache of kernel stacks).
+            SlabCache::get_cache(SlabCache::STACK_CACHE)->free((void*)tcb->sys_stack);
             tcb->sys_stack = nullptr;
 
             Sem::free_sem(tcb->join_sem);
             tcb->join_sem = nullptr;
 
-            MemoryAllocator::get_instance().free(tcb);
+            SlabCache::get_cache(SlabCache::TCB_CACHE)->free(tcb);
+        }
+    }
+
+    TCB* get_live_tcb(TCB* handle) {
+        if (!handle) {
+            return get_current_tcb();
+        }
+
+        // Main thread is the only one that is not in the cache of TCBs. Terminating thread is about to be freed, it can't be changed anymore.
+        // Handle of a thread that has been freed, and whose TCB was then given to a new thread, refers to that new thread, as handles are just the addresses of TCBs.
+        if (handle != &main_tcb && !SlabCache::get_cache(SlabCache::TCB_CACHE)->is_allocated(handle)) {
+            return nullptr;
         }
+        return (handle->status == TCBStatus::TERMINATING) ? nullptr : handle;
+    }
+
+    static void suspend_fp_context(TCB* tcb) {
+        // Trap entry has saved sstatus of the thread, and the kernel doesn't use FP registers (it is built without F and D), so FS in the context is the state of the FP registers of this hart, which still belong to the thread.
+        // They are saved only if the thread has changed them since they were loaded (Dirty), threads that haven't touched them since they were switched to (Off) or only read them (Clean) skip that.
+        if ((tcb->context.sstatus & SSTATUS_FS) == SSTATUS_FS_DIRTY) {
+            k_save_fp_context(&tcb->fp_context);
+            get_hart().n_fp_saves++;
+        }
+
+        // FP is turned off for the thread, so its first FP instruction after it is switched back to (on any hart) traps, and its registers are loaded then (k_handle_fast_ecall).
+        tcb->context.sstatus &= ~SSTATUS_FS;
     }
 
     void yield(TCB* old_tcb, TCB* new_tcb) {
-        if (old_tcb && k_save_context(&old_tcb->context) != 0) {
-            // In case old_tcb is passed, save its context. 
-            // In case the return value is not 0, then we are returning from context restauration.
-            // Because when we saved the context, we also saved "ra" return address registry. And when we are restoring the context.
-            // Then we will return where we were supposed to after that, which is here. In that case, set the time ticks to be 0.
-            // As it has been 0 time ticks ever since the last context switch, as it just happened.
-            timer_ticks = 0;
+        if (!new_tcb) {
             return;
         }
 
-        if (new_tcb) {
-            // If new_tcb is passed, set its status that its running, restore its context. We came here if we truly saved context of old_tcb.
-            // However, we might return from k_save_context for new_tcb with result that is not zero, in case we have previously saved the context for new_tcb some time in the past.
-            new_tcb->status = TCBStatus::RUNNING;
-            k_current_context = &current_tcb->context;
-            k_restore_context(&new_tcb->context);
+        // Set the status of the new thread that its running, ticks are counted from zero for it, this matters for threads that run for the first time, as they don't return to yield.
+        // The new thread was taken from the run queue of this hart, so its hart is already this one, and sscratch of this hart has to point to its context from now on.
+        // Timer of the hart is programmed for the end of the time slice of the new thread, as there are no periodic ticks that would tell us when that is.
+        Hart& hart = harts[new_tcb->hart];
+        new_tcb->status = TCBStatus::RUNNING;
+        hart.current_tcb = new_tcb;
+        hart.timer_ticks = 0;
+        __asm__ volatile ("csrw sscratch, %0" : : "r" (&new_tcb->context));
+        Timer::get_instance().program();
+
+        if (old_tcb != new_tcb) {
+            if (old_tcb) {
+                suspend_fp_context(old_tcb);
+            }
+            hart.n_context_switches++;
+
+            // Only the callee-saved registers are switched, yield is an ordinary function, so the compiler doesn't expect anything else to survive the call.
+            // The old thread returns from k_switch_context once some hart switches back to it, it may be a different hart than the one it was suspended on.
+            k_switch_context(old_tcb ? &old_tcb->switch_context : nullptr, &new_tcb->switch_context);
+            get_hart().timer_ticks = 0;
         }
     }
 
     void dispatch() {
-        TCB* previous_tcb = current_tcb;
+        // Count the ticks that the previous thread has used since the last timer interrupt, the scheduler needs them to decide on which level it goes back.
+        Timer::get_instance().update();
+        TCB* previous_tcb = get_current_tcb();
 
-        if (previous_tcb && previous_tcb->status == TCBStatus::RUNNING) {
-            // If we have previous thread, and if it is not done, add it back to the scheduler.
+        if (previous_tcb->status == TCBStatus::RUNNING) {
+            // If the previous thread is not done, add it back to the scheduler.
             Scheduler::get_instance().put_tcb(previous_tcb);
         }
-        else if (previous_tcb && previous_tcb->status == TCBStatus::TERMINATING) {
-            // If it did finish, deallocate it, but before that, close its semaphore for join operations.
+        else if (previous_tcb->status == TCBStatus::TERMINATING) {
+            // If it did finish, give back its share of the real-time capacity of its hart (if it had one).
+            // And close its semaphore for join operations, so that the threads that wait for it can be picked right away.
+            Scheduler::get_instance().set_real_time(previous_tcb, 0, 0, 0);
             if (previous_tcb->join_sem) {
                 previous_tcb->join_sem->close();
             }
+        }
+
+        // Pick different thread from scheduler. The scheduler finds the hart through the previous thread, so it is deallocated (if it did finish) only after that.
+        TCB* next_tcb = Scheduler::get_instance().next_tcb();
+        if (previous_tcb->status == TCBStatus::TERMINATING) {
             free_tcb(previous_tcb);
             previous_tcb = nullptr;
         }
 
-        // Pick different thread from scheduler, switch context.
-        current_tcb = Scheduler::get_instance().next_tcb();
-        yield(previous_tcb, current_tcb);
+        // Switch context.
+        yield(previous_tcb, next_tcb);
     }
     
     extern "C" void k_tcb_run_wrapper() {
         // Start the thread with the given arguments, once it is done, call the system call to shut down the thread.
         // This function will not be name mangled in C++ way, so that we can use it from the assembly easily.
+        TCB* current_tcb = get_current_tcb();
         current_tcb->body(current_tcb->args);
         thread_exit();
     }
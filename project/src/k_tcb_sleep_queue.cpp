@@ -65,15 +65,21 @@ namespace Kernel {
         }
     }
 
-    void TCBSleepQueue::timer_tick() {
-        if (!this->is_empty()) {
-            // In case the queue for sleeping isn't empty, take the first TCB, and decrement its ticks for sleeping by one.
-            this->peek_first()->sleep_for--;
-
-            while (!this->is_empty() && this->peek_first()->sleep_for <= 0) {
-                // As long as the queue is not empty, and as long as the time of the first TCB has expired, take that TCB and add it to the scheduler.
-                Scheduler::get_instance().put_tcb(this->take_first());
+    void TCBSleepQueue::timer_tick(time_t ticks) {
+        while (!this->is_empty()) {
+            if (this->peek_first()->sleep_for > ticks) {
+                // First TCB sleeps longer than the ticks that have passed, so it just has that many ticks less to sleep, the TCBs after it are relative to it, so they stay the same.
+                this->peek_first()->sleep_for -= ticks;
+                return;
             }
+
+            // Time of the first TCB has expired, take that TCB and add it to the scheduler, the ticks that are left over are counted against the TCBs after it.
+            ticks -= this->peek_first()->sleep_for;
+            Scheduler::get_instance().put_tcb(this->take_first());
         }
     }
+
+    time_t TCBSleepQueue::get_first_sleep_for() {
+        return this->peek_first()->sleep_for;
+    }
 }
\ No newline at end of file
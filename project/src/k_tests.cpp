@@ -1,5 +1,12 @@
 #include "k_tests.hpp"
 #include "syscall_cpp.hpp"
+#include "k_utils.hpp"
+#include "k_hart.hpp"
+#include "k_trap_handlers.hpp"
+#include "k_syscall_codes.hpp"
+#include "k_syscall_table.hpp"
+#include "k_timer.hpp"
+#include "k_memory.hpp"
 
 
 // Static (internal linkage) helper functions. They aren't in the Console C++ API class because it's kind of expected for user to code his own versions if he needs them, as they are specific.
@@ -103,6 +110,235 @@ void Kernel::Tests::memory_test() {
 }
 
 
+static uint64 time_alloc_free_pairs(int n_pairs, size_t min_size, size_t max_size) {
+    // Allocate and immediately free memory of sizes that go round robin from min_size to max_size, and return how many mtime ticks that took.
+    uint64 start = Kernel::Utils::read_mtime();
+    for (int i = 0; i < n_pairs; ++i) {
+        void* address = mem_alloc(min_size + (i * MEM_BLOCK_SIZE) % (max_size - min_size + MEM_BLOCK_SIZE));
+        mem_free(address);
+    }
+    return Kernel::Utils::read_mtime() - start;
+}
+
+void Kernel::Tests::memory_benchmark() {
+    constexpr int N_FRAGMENTS = 1024;
+    constexpr int N_PAIRS = 1024;
+
+    // Fragment the heap, allocate a lot of single blocks, and then free every other one. That way we get N_FRAGMENTS / 2 free fragments that can't be merged.
+    void** fragments = (void**)mem_alloc(sizeof(void*) * N_FRAGMENTS);
+    for (int i = 0; i < N_FRAGMENTS; ++i) {
+        fragments[i] = mem_alloc(MEM_BLOCK_SIZE);
+    }
+    for (int i = 1; i < N_FRAGMENTS; i += 2) {
+        mem_free(fragments[i]);
+    }
+
+    // Heap counters should now show at least N_FRAGMENTS / 2 free extents.
+    Console::print_mem_stats();
+    print_horizontal_line(35);
+
+    // Sizes that the fragments can satisfy exactly, and sizes that none of them can, for which a single Best-Fit list would have to be walked through completely.
+    const char* range_names[3] = { "EXACT FIT (1 BLOCK) MTIME TICKS:", "SMALL (2-64 BLOCKS) MTIME TICKS:", "LARGE (65-512 BLOCKS) MTIME TICKS:" };
+    size_t min_sizes[3] = { MEM_BLOCK_SIZE, 2 * MEM_BLOCK_SIZE, 65 * MEM_BLOCK_SIZE };
+    size_t max_sizes[3] = { MEM_BLOCK_SIZE, 64 * MEM_BLOCK_SIZE, 512 * MEM_BLOCK_SIZE };
+    uint64 bin_ticks[3], linear_ticks[3];
+    for (int i = 0; i < 3; ++i) {
+        bin_ticks[i] = time_alloc_free_pairs(N_PAIRS, min_sizes[i], max_sizes[i]);
+    }
+
+#if MEM_BUDDY_ALLOCATOR == 0
+    // The same work once more, with the Best-Fit walk through all of the free elements (the way alloc worked before the bins), the heap is in the same state as the pairs free what they take.
+    Kernel::linear_best_fit = true;
+    for (int i = 0; i < 3; ++i) {
+        linear_ticks[i] = time_alloc_free_pairs(N_PAIRS, min_sizes[i], max_sizes[i]);
+    }
+    Kernel::linear_best_fit = false;
+#else
+    // Buddy system has no Best-Fit walk to compare with.
+    for (int i = 0; i < 3; ++i) {
+        linear_ticks[i] = 0;
+    }
+#endif
+
+    Console::print_string("MEMORY BENCHMARK, FREE FRAGMENTS:", ' ');
+    Console::print_uint64(N_FRAGMENTS / 2, ',');
+    Console::print_string(" ALLOC/FREE PAIRS PER SIZE RANGE:", ' ');
+    Console::print_uint64(N_PAIRS);
+    Console::print_string("SIZE RANGE: BINS / LINEAR BEST-FIT (0 FOR BUDDY SYSTEM)");
+    for (int i = 0; i < 3; ++i) {
+        Console::print_string(range_names[i], ' ');
+        Console::print_uint64(bin_ticks[i], ' ');
+        Console::print_string("/", ' ');
+        Console::print_uint64(linear_ticks[i]);
+    }
+    print_horizontal_line(35);
+
+    for (int i = 0; i < N_FRAGMENTS; i += 2) {
+        mem_free(fragments[i]);
+    }
+    mem_free(fragments);
+
+    // Once everything is freed, the fragments are merged back, so the free memory should be in a few extents again.
+    Console::print_mem_stats();
+    print_horizontal_line(35);
+}
+
+
+static void print_slab_stats() {
+    const char* names[3] = { "TCB CACHE:", "SEM CACHE:", "STACK CACHE:" };
+    int caches[3] = { SLAB_CACHE_TCB, SLAB_CACHE_SEM, SLAB_CACHE_STACK };
+
+    // Print "name slabs used free" for every kernel object cache.
+    for (int i = 0; i < 3; ++i) {
+        slab_stats_t stats;
+        if (slab_stats(caches[i], &stats) == 0) {
+            Console::print_string(names[i], ' ');
+            Console::print_uint64(stats.slabs, ' ');
+            Console::print_uint64(stats.objects_used, ' ');
+            Console::print_uint64(stats.objects_free);
+        }
+    }
+    print_horizontal_line(35);
+}
+
+void Kernel::Tests::slab_cache_test() {
+    print_slab_stats();
+
+    // Every thread takes one TCB, one kernel stack, and one semaphore for join, and every semaphore takes one semaphore object.
+    Semaphore mutex(1);
+    Thread thread_array[3] = {
+        Thread([](void* args) { ((Semaphore*)args)->wait(); ((Semaphore*)args)->signal(); }, &mutex),
+        Thread([](void* args) { ((Semaphore*)args)->wait(); ((Semaphore*)args)->signal(); }, &mutex),
+        Thread([](void* args) { ((Semaphore*)args)->wait(); ((Semaphore*)args)->signal(); }, &mutex)
+    };
+
+    mutex.wait();
+    for (int i = 0; i < 3; i++) {
+        thread_array[i].start();
+    }
+    print_slab_stats();
+    mutex.signal();
+
+    // Once joined, the threads are already torn down, so their objects went back to the caches.
+    for (int i = 0; i < 3; i++) {
+        thread_array[i].join();
+    }
+    print_slab_stats();
+}
+
+void Kernel::Tests::aligned_realloc_test() {
+    // Page and cache line aligned allocations, with a small allocation in between, so that the heap isn't already aligned by accident.
+    uint64* small = (uint64*)mem_alloc(MEM_BLOCK_SIZE);
+    uint64* page = (uint64*)mem_alloc_aligned(4096, 4096);
+    uint64* line = (uint64*)mem_alloc_aligned(100, 128);
+
+    Console::print_string("PAGE ALIGNED:", ' ');
+    Console::print_string(page && (uint64)page % 4096 == 0 ? "OK" : "FAILED");
+    Console::print_string("128B ALIGNED:", ' ');
+    Console::print_string(line && (uint64)line % 128 == 0 ? "OK" : "FAILED");
+    print_horizontal_line(35);
+
+    mem_free(line);
+    mem_free(page);
+    mem_free(small);
+
+    // Grow a buffer one block at a time, like a growable queue would, and count how many times it could grow without being moved.
+    constexpr int N_GROWS = 64;
+    constexpr uint64 WORDS_PER_BLOCK = MEM_BLOCK_SIZE / sizeof(uint64);
+
+    uint64* buffer = (uint64*)mem_alloc(MEM_BLOCK_SIZE);
+    bool data_kept = (buffer != nullptr);
+    int moves = 0;
+
+    for (int i = 1; i <= N_GROWS && data_kept; ++i) {
+        for (uint64 j = (i - 1) * WORDS_PER_BLOCK; j < i * WORDS_PER_BLOCK; ++j) {
+            buffer[j] = j;
+        }
+
+        uint64* grown = (uint64*)mem_realloc(buffer, (i + 1) * MEM_BLOCK_SIZE);
+        if (!grown) {
+            data_kept = false;
+            break;
+        }
+        moves += (grown != buffer);
+        buffer = grown;
+
+        for (uint64 j = 0; j < i * WORDS_PER_BLOCK; ++j) {
+            data_kept = data_kept && (buffer[j] == j);
+        }
+    }
+
+    // Shrinking never moves the buffer.
+    uint64* shrunk = (uint64*)mem_realloc(buffer, MEM_BLOCK_SIZE);
+    data_kept = data_kept && (shrunk == buffer) && (shrunk[0] == 0);
+
+    Console::print_string("REALLOC GROWS:", ' ');
+    Console::print_uint64(N_GROWS, ',');
+    Console::print_string(" MOVES:", ' ');
+    Console::print_uint64(moves);
+    Console::print_string("REALLOC DATA:", ' ');
+    Console::print_string(data_kept ? "OK" : "FAILED");
+
+    // Requests for no memory get nothing, but the heap didn't fail them, so they are not failed allocations.
+    mem_stats_t stats_before, stats_after;
+    mem_stats(&stats_before);
+    bool empty_rejected = !mem_alloc(0) && !mem_realloc(nullptr, 0);
+    mem_stats(&stats_after);
+    Console::print_string("EMPTY REQUESTS NOT COUNTED AS FAILED:", ' ');
+    Console::print_string(empty_rejected && stats_after.failed_allocs == stats_before.failed_allocs ? "OK" : "FAILED");
+    print_horizontal_line(35);
+
+    mem_free(shrunk);
+}
+
+void Kernel::Tests::cpp_arena_test() {
+    constexpr int N_OBJECTS = 256;
+    constexpr int N_PAIRS = 1024;
+
+    // Objects of all the size classes (and a few big ones), each one filled with its own index, they must not overlap, and must be 16B aligned.
+    uint8* objects[N_OBJECTS];
+    for (int i = 0; i < N_OBJECTS; ++i) {
+        size_t size = 1 + (i * 37) % ((i % 16 == 0) ? 4096 : 1024);
+        objects[i] = new uint8[size];
+        for (size_t j = 0; j < size; ++j) {
+            objects[i][j] = (uint8)i;
+        }
+        objects[i][0] = (uint8)((uint64)objects[i] % 16);
+    }
+
+    bool objects_ok = true;
+    for (int i = 0; i < N_OBJECTS; ++i) {
+        size_t size = 1 + (i * 37) % ((i % 16 == 0) ? 4096 : 1024);
+        objects_ok = objects_ok && objects[i][0] == 0;
+        for (size_t j = 1; j < size; ++j) {
+            objects_ok = objects_ok && objects[i][j] == (uint8)i;
+        }
+        delete[] objects[i];
+    }
+
+    // Small object new/delete pairs are served by the arena, while mem_alloc/mem_free pairs go to the kernel every time.
+    uint64 start = Kernel::Utils::read_mtime();
+    for (int i = 0; i < N_PAIRS; ++i) {
+        delete[] new uint64[4];
+    }
+    uint64 arena_ticks = Kernel::Utils::read_mtime() - start;
+
+    start = Kernel::Utils::read_mtime();
+    for (int i = 0; i < N_PAIRS; ++i) {
+        mem_free(mem_alloc(sizeof(uint64) * 4));
+    }
+    uint64 syscall_ticks = Kernel::Utils::read_mtime() - start;
+
+    Console::print_string("ARENA OBJECTS:", ' ');
+    Console::print_string(objects_ok ? "OK" : "FAILED");
+    Console::print_string("NEW/DELETE PAIRS MTIME TICKS:", ' ');
+    Console::print_uint64(arena_ticks);
+    Console::print_string("MEM_ALLOC/MEM_FREE PAIRS MTIME TICKS:", ' ');
+    Console::print_uint64(syscall_ticks);
+    print_horizontal_line(35);
+}
+
+
 namespace {
     // Functions/Classes with internal linking, used by threads_test().
     void print_loop_standard(void* args) {
@@ -190,6 +426,619 @@ void Kernel::Tests::semaphore_test() {
 }
 
 
+namespace {
+    // Used by scheduler_test(), CPU bound threads spin until the interactive thread is done.
+    bool volatile interactive_done = false;
+
+    void cpu_bound_loop(void* args) {
+        while (!interactive_done) {
+            (*(uint64 volatile*)args)++;
+        }
+    }
+
+    void interactive_loop(void* args) {
+        // Sleep for one tick many times, with a fair share of the CPU every wake up would wait behind the time slices of all CPU bound threads.
+        uint64 start = Kernel::Utils::read_mtime();
+        for (int i = 0; i < 20; ++i) {
+            time_sleep(1);
+        }
+        *(uint64*)args = Kernel::Utils::read_mtime() - start;
+        interactive_done = true;
+    }
+}
+
+void Kernel::Tests::scheduler_test() {
+    uint64 spins[3] = { 0, 0, 0 };
+    uint64 interactive_ticks = 0;
+
+    Thread cpu_threads[3] = {
+        Thread(cpu_bound_loop, &spins[0]),
+        Thread(cpu_bound_loop, &spins[1]),
+        Thread(cpu_bound_loop, &spins[2])
+    };
+    Thread interactive_thread(interactive_loop, &interactive_ticks);
+
+    for (int i = 0; i < 3; ++i) {
+        cpu_threads[i].start();
+    }
+    interactive_thread.start();
+
+    interactive_thread.join();
+    for (int i = 0; i < 3; ++i) {
+        cpu_threads[i].join();
+    }
+
+    // CPU bound threads sink to the lower levels of the scheduler, so the interactive thread should wake up right away, and the spins should still be spread evenly.
+    Console::print_string("20 SLEEPS OF 1 TICK NEXT TO 3 CPU BOUND THREADS, MTIME TICKS:", ' ');
+    Console::print_uint64(interactive_ticks);
+    for (int i = 0; i < 3; ++i) {
+        Console::print_string("CPU BOUND THREAD SPINS:", ' ');
+        Console::print_uint64(spins[i]);
+    }
+    print_horizontal_line(35);
+}
+
+
+namespace {
+    // Used by priority_test(), every thread writes down when it got to run.
+    int volatile run_order[3];
+    int volatile n_finished = 0;
+
+    void record_run(void* args) {
+        run_order[n_finished++] = *(int*)args;
+    }
+
+    // Priority that the thread had on its very first instruction.
+    void record_priority(void* args) {
+        *(int*)args = thread_get_priority(nullptr);
+    }
+}
+
+void Kernel::Tests::priority_test() {
+    // Main thread takes the highest priority, so that none of the new threads runs before main thread waits for them.
+    thread_set_priority(nullptr, THREAD_PRIORITY_HIGHEST);
+
+    int priorities[3] = { THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_DEFAULT, THREAD_PRIORITY_HIGHEST + 1 };
+    Thread threads[3] = {
+        Thread(record_run, &priorities[0], priorities[0]),
+        Thread(record_run, &priorities[1], priorities[1]),
+        Thread(record_run, &priorities[2], priorities[2])
+    };
+
+    for (int i = 0; i < 3; ++i) {
+        threads[i].start();
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        threads[i].join();
+    }
+    thread_set_priority(nullptr, THREAD_PRIORITY_DEFAULT);
+
+    // Threads were started from the lowest priority to the highest, but they should run from the highest to the lowest.
+    Console::print_string("PRIORITIES IN THE ORDER THE THREADS RAN:", ' ');
+    for (int i = 0; i < 3; ++i) {
+        Console::print_uint64(run_order[i], ' ');
+    }
+    Console::print_string(run_order[0] < run_order[1] && run_order[1] < run_order[2] ? "OK" : "FAILED");
+    Console::print_string("MAIN THREAD PRIORITY:", ' ');
+    Console::print_uint64(thread_get_priority(nullptr));
+
+    // Creator of the lowest priority starts a thread of the highest one, which takes over right away, so it has to have its priority already.
+    int first_priority = -1;
+    thread_set_priority(nullptr, THREAD_PRIORITY_LOWEST);
+    Thread urgent_thread(record_priority, &first_priority, THREAD_PRIORITY_HIGHEST);
+    urgent_thread.start();
+    urgent_thread.join();
+    thread_set_priority(nullptr, THREAD_PRIORITY_DEFAULT);
+
+    Console::print_string("PRIORITY OF THE THREAD ON ITS FIRST INSTRUCTION:", ' ');
+    Console::print_uint64(first_priority, ' ');
+    Console::print_string(first_priority == THREAD_PRIORITY_HIGHEST ? "OK" : "FAILED");
+
+    // Thread that has exited can't be changed anymore, and invalid priority fails the creation of the thread.
+    thread_t invalid_handle = nullptr;
+    thread_attr_t invalid_attr = { THREAD_PRIORITY_LOWEST + 1, TIME_SLICE_DEFAULT, THREAD_AFFINITY_ALL };
+    Console::print_string("EXITED THREAD AND INVALID PRIORITY REJECTED:", ' ');
+    Console::print_string(thread_set_priority(urgent_thread.myHandle, THREAD_PRIORITY_DEFAULT) < 0 &&
+                          thread_create_attr(&invalid_handle, record_priority, &first_priority, &invalid_attr) < 0 && !invalid_handle ? "OK" : "FAILED");
+
+    // Handles that were never returned by thread_create (garbage, and an address on the stack) are rejected without the kernel touching them.
+    Console::print_string("GARBAGE HANDLES REJECTED:", ' ');
+    Console::print_string(thread_set_priority((thread_t)0xdeadbeef, THREAD_PRIORITY_DEFAULT) < 0 &&
+                          thread_set_time_slice((thread_t)&first_priority, TIME_SLICE_DEFAULT) < 0 &&
+                          thread_set_affinity((thread_t)&invalid_attr, THREAD_AFFINITY_ALL) < 0 ? "OK" : "FAILED");
+    print_horizontal_line(35);
+}
+
+
+namespace {
+    // Used by time_slice_test(), batch thread spins without being preempted, while the other thread would like to run.
+    uint64 volatile background_spins = 0;
+    bool volatile batch_done = false;
+
+    void background_loop(void* args) {
+        while (!batch_done) {
+            background_spins++;
+        }
+    }
+
+    void batch_loop(void* args) {
+        // Spin long enough to span many timer ticks, and check whether the background thread got to run in the meantime.
+        uint64 spins_before = background_spins;
+        uint64 start = Kernel::Utils::read_mtime();
+        for (uint64 volatile i = 0; i < 20000000; ++i);
+        *(uint64*)args = Kernel::Utils::read_mtime() - start;
+
+        Console::print_string("UNBOUNDED TIME SLICE, BACKGROUND THREAD RAN IN BETWEEN:", ' ');
+        Console::print_string(background_spins == spins_before ? "NO" : "YES");
+        batch_done = true;
+    }
+
+    // Two threads share hart 0 for a fixed number of ticks, and count how many times they took the hart over from each other, the longer the time slice, the fewer times.
+    struct SliceShare {
+        int volatile n_pinned;
+        int volatile last_runner;
+        uint64 volatile end;
+        uint64 volatile switches;
+    };
+
+    struct SliceSpinner {
+        SliceShare* share;
+        int id;
+    };
+
+    void slice_spinner(void* args) {
+        SliceSpinner* spinner = (SliceSpinner*)args;
+        SliceShare* share = spinner->share;
+
+        // Until both threads are on hart 0 they may run side by side on different harts, so the switches are counted only from then on. Dispatch moves the thread there.
+        thread_set_affinity(nullptr, 1);
+        thread_dispatch();
+        if (__atomic_add_fetch(&share->n_pinned, 1, __ATOMIC_SEQ_CST) == 2) {
+            share->end = Kernel::Utils::read_mtime() + 40 * Kernel::Timer::TIMER_INTERVAL;
+        }
+        while (!share->end) {
+            thread_dispatch();
+        }
+        while (Kernel::Utils::read_mtime() < share->end) {
+            if (share->last_runner != spinner->id) {
+                share->last_runner = spinner->id;
+                share->switches++;
+            }
+        }
+    }
+
+    uint64 count_slice_switches(time_t default_time_slice) {
+        thread_set_default_time_slice(default_time_slice);
+        SliceShare share = { 0, -1, 0, 0 };
+        SliceSpinner spinners[2] = { { &share, 0 }, { &share, 1 } };
+        Thread first(slice_spinner, &spinners[0]), second(slice_spinner, &spinners[1]);
+        first.start();
+        second.start();
+        first.join();
+        second.join();
+        thread_set_default_time_slice(DEFAULT_TIME_SLICE);
+        return share.switches;
+    }
+}
+
+void Kernel::Tests::time_slice_test() {
+    uint64 batch_ticks = 0;
+
+    Thread background_thread(background_loop, nullptr);
+    Thread batch_thread(batch_loop, &batch_ticks);
+    batch_thread.set_time_slice(TIME_SLICE_UNBOUNDED);
+
+    background_thread.start();
+    batch_thread.start();
+
+    batch_thread.join();
+    background_thread.join();
+
+    Console::print_string("UNBOUNDED BATCH THREAD MTIME TICKS:", ' ');
+    Console::print_uint64(batch_ticks);
+
+    // Threads that don't have their own time slice use the default one, so with 10 times longer default time slice, the threads that share a hart should take turns far less often.
+    uint64 short_switches = count_slice_switches(1);
+    uint64 long_switches = count_slice_switches(10);
+    Console::print_string("SWITCHES IN 40 TICKS WITH DEFAULT TIME SLICE OF 1 AND 10 TICKS:", ' ');
+    Console::print_uint64(short_switches, ' ');
+    Console::print_uint64(long_switches, ' ');
+    Console::print_string(long_switches < short_switches ? "OK" : "FAILED");
+
+    // Time slice of a thread that has exited can't be set.
+    Console::print_string("TIME SLICE OF EXITED THREAD REJECTED:", ' ');
+    Console::print_string(thread_set_time_slice(batch_thread.myHandle, 10) < 0 ? "OK" : "FAILED");
+    print_horizontal_line(35);
+}
+
+
+namespace {
+    // Used by smp_benchmark(), the same amount of work is done by one thread, and then split between several threads, that run on all of the harts.
+    constexpr int SMP_BENCH_THREADS = 8;
+    constexpr uint64 SMP_BENCH_WORK = 16000000;
+
+    void smp_work(void* args) {
+        for (uint64 volatile i = 0; i < *(uint64*)args; ++i);
+    }
+
+    uint64 run_smp_work(int n_threads) {
+        uint64 work = SMP_BENCH_WORK / n_threads;
+        Thread* threads[SMP_BENCH_THREADS];
+
+        uint64 start = Kernel::Utils::read_mtime();
+        for (int i = 0; i < n_threads; ++i) {
+            threads[i] = new Thread(smp_work, &work);
+            threads[i]->start();
+        }
+
+        for (int i = 0; i < n_threads; ++i) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        return Kernel::Utils::read_mtime() - start;
+    }
+}
+
+void Kernel::Tests::smp_benchmark() {
+    sched_stats_t stats_before, stats_after;
+    sched_stats(&stats_before);
+    uint64 single_ticks = run_smp_work(1);
+    uint64 parallel_ticks = run_smp_work(SMP_BENCH_THREADS);
+    sched_stats(&stats_after);
+
+    // Speedup is in percents, with one hart it should be around 100, and with more harts it should grow close to 100 times the number of harts.
+    Console::print_string("SMP BENCHMARK HARTS:", ' ');
+    Console::print_uint64(MAX_HARTS);
+    Console::print_string("ONE THREAD MTIME TICKS:", ' ');
+    Console::print_uint64(single_ticks);
+    Console::print_string("EIGHT THREADS MTIME TICKS:", ' ');
+    Console::print_uint64(parallel_ticks);
+    Console::print_string("SPEEDUP IN PERCENTS:", ' ');
+    Console::print_uint64(parallel_ticks ? single_ticks * 100 / parallel_ticks : 0);
+
+    // Threads that finish early leave their harts with nothing to run, so those harts should steal the rest of the threads from the busier ones (with more than one hart).
+    Console::print_string("STEALS:", ' ');
+    Console::print_uint64(stats_after.steals - stats_before.steals);
+    Console::print_string("MIGRATIONS:", ' ');
+    Console::print_uint64(stats_after.migrations - stats_before.migrations);
+    print_horizontal_line(35);
+}
+
+
+namespace {
+    // Used by context_switch_benchmark(), every thread yields this many times, with two of them on the same hart every yield is a context switch.
+    constexpr uint64 SWITCH_BENCH_ROUNDS = 10000;
+
+    // Yielding threads count how many times they found themselves outside of hart 0, before and after the yields (not in between, that would be measured as well).
+    uint64 volatile switch_bench_off_hart = 0;
+
+    void switch_ping(void*) {
+        if (thread_get_hart() != 0) {
+            switch_bench_off_hart++;
+        }
+        for (uint64 i = 0; i < SWITCH_BENCH_ROUNDS; ++i) {
+            thread_dispatch();
+        }
+        if (thread_get_hart() != 0) {
+            switch_bench_off_hart++;
+        }
+    }
+
+    uint64 run_switch_bench(int n_threads) {
+        // Main thread and the yielding threads are all on hart 0, the yielding threads at the highest priority, so that they run only once the main thread lowers its own, and they run only against each other.
+        // Yielding threads are created with their mask and priority (set before start), so none of them can run before that, or on another hart.
+        Thread* threads[2];
+        thread_set_affinity(nullptr, 1);
+        thread_set_priority(nullptr, THREAD_PRIORITY_HIGHEST);
+        for (int i = 0; i < n_threads; ++i) {
+            threads[i] = new Thread(switch_ping, nullptr, THREAD_PRIORITY_HIGHEST);
+            threads[i]->set_affinity(1);
+            threads[i]->start();
+        }
+
+        uint64 start = Kernel::Utils::read_cycle();
+        thread_set_priority(nullptr, THREAD_PRIORITY_DEFAULT);
+        uint64 cycles = Kernel::Utils::read_cycle() - start;
+
+        for (int i = 0; i < n_threads; ++i) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        thread_set_affinity(nullptr, THREAD_AFFINITY_ALL);
+        return cycles / (n_threads * SWITCH_BENCH_ROUNDS);
+    }
+}
+
+void Kernel::Tests::context_switch_benchmark() {
+    // Thread that yields alone pays for the system call and the scheduler, but it isn't switched, two threads that yield to each other pay for the context switch on top of that.
+    uint64 yield_cycles = run_switch_bench(1);
+    uint64 switch_cycles = run_switch_bench(2);
+
+    Console::print_string("CYCLES PER YIELD WITHOUT A SWITCH:", ' ');
+    Console::print_uint64(yield_cycles);
+    Console::print_string("CYCLES PER YIELD WITH A SWITCH (PING-PONG):", ' ');
+    Console::print_uint64(switch_cycles);
+
+    // Threads are created with their mask, so they never run anywhere but on hart 0, otherwise the numbers above wouldn't be the costs of switches on one hart.
+    Console::print_string("ALL YIELDING THREADS ON HART 0:", ' ');
+    Console::print_string(switch_bench_off_hart == 0 ? "OK" : "FAILED");
+    print_horizontal_line(35);
+}
+
+
+namespace {
+    // Used by syscall_benchmark(), every system call is made this many times in a row, and the average round trip (from the ecall to the instruction after it) is reported.
+    constexpr uint64 SYSCALL_BENCH_ROUNDS = 1000;
+    constexpr int SYSCALL_BENCH_CALLS = 4;
+    const char* syscall_bench_names[SYSCALL_BENCH_CALLS] = { "SEM_SIGNAL:", "SEM_WAIT (NO BLOCKING):", "MEM_ALLOC + MEM_FREE:", "THREAD_GET_PRIORITY:" };
+
+    void measure_syscalls(uint64* cycles) {
+        sem_t sem;
+        sem_open(&sem, 0);
+
+        uint64 start = Kernel::Utils::read_cycle();
+        for (uint64 i = 0; i < SYSCALL_BENCH_ROUNDS; ++i) {
+            sem_signal(sem);
+        }
+        cycles[0] = (Kernel::Utils::read_cycle() - start) / SYSCALL_BENCH_ROUNDS;
+
+        // Semaphore was signaled as many times as it is waited on now, so none of the waits block.
+        start = Kernel::Utils::read_cycle();
+        for (uint64 i = 0; i < SYSCALL_BENCH_ROUNDS; ++i) {
+            sem_wait(sem);
+        }
+        cycles[1] = (Kernel::Utils::read_cycle() - start) / SYSCALL_BENCH_ROUNDS;
+
+        start = Kernel::Utils::read_cycle();
+        for (uint64 i = 0; i < SYSCALL_BENCH_ROUNDS; ++i) {
+            mem_free(mem_alloc(64));
+        }
+        cycles[2] = (Kernel::Utils::read_cycle() - start) / SYSCALL_BENCH_ROUNDS;
+
+        start = Kernel::Utils::read_cycle();
+        for (uint64 i = 0; i < SYSCALL_BENCH_ROUNDS; ++i) {
+            thread_get_priority(nullptr);
+        }
+        cycles[3] = (Kernel::Utils::read_cycle() - start) / SYSCALL_BENCH_ROUNDS;
+
+        sem_close(sem);
+    }
+}
+
+void Kernel::Tests::syscall_benchmark() {
+    // The same system calls are measured through the full path of the ecall trap (all of the registers are saved), and through the fast path (only the caller-saved ones are).
+    // Thread is pinned to one hart while it measures, as the cycle counters of different harts are not comparable.
+    uint64 full_cycles[SYSCALL_BENCH_CALLS], fast_cycles[SYSCALL_BENCH_CALLS];
+    thread_set_affinity(nullptr, 1);
+
+    Kernel::fast_syscalls = false;
+    measure_syscalls(full_cycles);
+    Kernel::fast_syscalls = true;
+    measure_syscalls(fast_cycles);
+
+    thread_set_affinity(nullptr, THREAD_AFFINITY_ALL);
+
+    // Cycles that the fast path saves are printed as well, 0 if it is not faster (the counters are noisy, so that doesn't fail the test).
+    Console::print_string("SYSCALL ROUND TRIP CYCLES (FULL PATH / FAST PATH / SAVED)");
+    for (int i = 0; i < SYSCALL_BENCH_CALLS; ++i) {
+        Console::print_string(syscall_bench_names[i], ' ');
+        Console::print_uint64(full_cycles[i], ' ');
+        Console::print_string("/", ' ');
+        Console::print_uint64(fast_cycles[i], ' ');
+        Console::print_string("/", ' ');
+        Console::print_uint64(full_cycles[i] > fast_cycles[i] ? full_cycles[i] - fast_cycles[i] : 0);
+    }
+    print_horizontal_line(35);
+}
+
+namespace {
+    // Used by syscall_stats_test(), thread_get_priority is made this many times, and its counter has to grow by at least that much.
+    constexpr uint64 SYSCALL_STATS_CALLS = 100;
+
+    uint64 get_syscall_calls(syscall_stats_t* stats, int n_syscalls, uint64 code) {
+        for (int i = 0; i < n_syscalls; ++i) {
+            if (stats[i].code == code) {
+                return stats[i].calls;
+            }
+        }
+        return 0;
+    }
+
+    uint64 get_syscall_measured(syscall_stats_t* stats, int n_syscalls, uint64 code) {
+        uint64 measured = 0;
+        for (int i = 0; i < n_syscalls; ++i) {
+            for (int bucket = 0; stats[i].code == code && bucket < SYSCALL_HISTOGRAM_BUCKETS; ++bucket) {
+                measured += stats[i].histogram[bucket];
+            }
+        }
+        return measured;
+    }
+
+    void exit_right_away(void*) { }
+
+    void signal_after_sleep(void* args) {
+        time_sleep(1);
+        sem_signal((sem_t)args);
+    }
+}
+
+void Kernel::Tests::syscall_stats_test() {
+    // First call only counts the system calls in the table, so that there is space for the statistics of every one of them.
+    int n_syscalls = syscall_stats(nullptr, 0);
+    syscall_stats_t* stats = new syscall_stats_t[n_syscalls];
+
+    syscall_stats(stats, n_syscalls);
+    uint64 calls_before = get_syscall_calls(stats, n_syscalls, Kernel::THREAD_GET_PRIORITY_CODE);
+    for (uint64 i = 0; i < SYSCALL_STATS_CALLS; ++i) {
+        thread_get_priority(nullptr);
+    }
+    syscall_stats(stats, n_syscalls);
+    uint64 calls_after = get_syscall_calls(stats, n_syscalls, Kernel::THREAD_GET_PRIORITY_CODE);
+
+    Console::print_string("SYSCALL TABLE ENTRIES:", ' ');
+    Console::print_uint64(n_syscalls);
+    Console::print_string("THREAD_GET_PRIORITY CALLS COUNTED:", ' ');
+#if SYSCALL_STATS == 1
+    Console::print_string(calls_after - calls_before >= SYSCALL_STATS_CALLS ? "OK" : "FAILED");
+#else
+    Console::print_string(calls_after == 0 && calls_before == 0 ? "OK" : "FAILED");
+#endif
+
+    // Thread that exits never returns from thread_exit, it still has to be counted. Every sleep gives up the hart, so the sleeps are counted, but none of them is in the histogram.
+    uint64 exits_before = get_syscall_calls(stats, n_syscalls, Kernel::THREAD_EXIT_CODE);
+    uint64 sleeps_before = get_syscall_calls(stats, n_syscalls, Kernel::TIME_SLEEP_CODE);
+    uint64 sleeps_measured_before = get_syscall_measured(stats, n_syscalls, Kernel::TIME_SLEEP_CODE);
+    Thread exiting_thread(exit_right_away, nullptr);
+    exiting_thread.start();
+    exiting_thread.join();
+    time_sleep(1);
+    syscall_stats(stats, n_syscalls);
+    bool exit_and_sleep_counted = get_syscall_calls(stats, n_syscalls, Kernel::THREAD_EXIT_CODE) > exits_before &&
+                                  get_syscall_calls(stats, n_syscalls, Kernel::TIME_SLEEP_CODE) > sleeps_before;
+    bool sleep_measured = get_syscall_measured(stats, n_syscalls, Kernel::TIME_SLEEP_CODE) != sleeps_measured_before;
+
+    Console::print_string("THREAD_EXIT COUNTED, TIME_SLEEP NOT IN THE HISTOGRAM:", ' ');
+#if SYSCALL_STATS == 1
+    Console::print_string(exit_and_sleep_counted && !sleep_measured ? "OK" : "FAILED");
+#else
+    Console::print_string(!exit_and_sleep_counted && !sleep_measured ? "OK" : "FAILED");
+#endif
+
+    // Semaphore is signalled only once the waiter has blocked on it, its fast handler gives up on the wait, and the full path blocks, the wait is still one call.
+    sem_t sem = nullptr;
+    sem_open(&sem, 0);
+    Thread signalling_thread(signal_after_sleep, sem);
+    signalling_thread.start();
+    syscall_stats(stats, n_syscalls);
+    uint64 waits_before = get_syscall_calls(stats, n_syscalls, Kernel::SEM_WAIT_CODE);
+    sem_wait(sem);
+    syscall_stats(stats, n_syscalls);
+    uint64 waits_after = get_syscall_calls(stats, n_syscalls, Kernel::SEM_WAIT_CODE);
+    signalling_thread.join();
+    sem_close(sem);
+
+    Console::print_string("BLOCKING SEM_WAIT COUNTED ONCE:", ' ');
+#if SYSCALL_STATS == 1
+    Console::print_string(waits_after - waits_before == 1 ? "OK" : "FAILED");
+#else
+    Console::print_string(waits_after == 0 && waits_before == 0 ? "OK" : "FAILED");
+#endif
+
+    // Every system call that was made so far, with the lower bound (in cycles) of the histogram bucket that most of its calls fell into.
+    Console::print_string("SYSCALL CALLS / MOST CALLS TOOK AT LEAST THIS MANY CYCLES");
+    for (int i = 0; i < n_syscalls; ++i) {
+        if (stats[i].calls == 0) {
+            continue;
+        }
+
+        int top_bucket = 0;
+        for (int bucket = 1; bucket < SYSCALL_HISTOGRAM_BUCKETS; ++bucket) {
+            if (stats[i].histogram[bucket] > stats[i].histogram[top_bucket]) {
+                top_bucket = bucket;
+            }
+        }
+
+        Console::print_string(stats[i].name, stats[i].fast_path ? '*' : ' ');
+        Console::print_string(":", ' ');
+        Console::print_uint64(stats[i].calls, ' ');
+        Console::print_string("/", ' ');
+        Console::print_uint64(top_bucket ? 1UL << (top_bucket + Kernel::SYSCALL_HISTOGRAM_SHIFT) : 0);
+    }
+
+    delete[] stats;
+    print_horizontal_line(35);
+}
+
+
+namespace {
+    // Used by affinity_test(), every worker is pinned to one hart, and it checks on which hart it runs, after yields, sleeps, and waits on a semaphore.
+    constexpr int AFFINITY_THREADS = 6;
+    constexpr int AFFINITY_ROUNDS = 20;
+
+    struct AffinityParams {
+        Semaphore* start_sem;
+        uint64 hart;
+        uint64 violations;
+    };
+
+    void affinity_work(void* args) {
+        // Worker checks its hart from its very first instruction, it is created with its mask, so it can't start anywhere else.
+        AffinityParams* params = (AffinityParams*)args;
+        if ((uint64)thread_get_hart() != params->hart) {
+            params->violations++;
+        }
+        params->start_sem->wait();
+
+        for (int round = 0; round < AFFINITY_ROUNDS; ++round) {
+            for (uint64 volatile i = 0; i < 200000; ++i);
+            if ((uint64)thread_get_hart() != params->hart) {
+                params->violations++;
+            }
+
+            if (round % 4 == 0) {
+                time_sleep(1);
+            }
+            else {
+                thread_dispatch();
+            }
+        }
+    }
+}
+
+void Kernel::Tests::affinity_test() {
+    Semaphore start_sem(0);
+    AffinityParams params[AFFINITY_THREADS];
+    Thread* threads[AFFINITY_THREADS];
+
+    // Workers all wait for the semaphore, so that they are woken up through it.
+    for (int i = 0; i < AFFINITY_THREADS; ++i) {
+        params[i] = { &start_sem, i % MAX_HARTS, 0 };
+        threads[i] = new Thread(affinity_work, &params[i]);
+        threads[i]->set_affinity(1UL << params[i].hart);
+        threads[i]->start();
+    }
+
+    for (int i = 0; i < AFFINITY_THREADS; ++i) {
+        start_sem.signal();
+    }
+
+    uint64 violations = 0;
+    for (int i = 0; i < AFFINITY_THREADS; ++i) {
+        threads[i]->join();
+        violations += params[i].violations;
+        delete threads[i];
+    }
+
+    Console::print_string("PINNED THREADS SEEN OUTSIDE OF THEIR HARTS:", ' ');
+    Console::print_uint64(violations, ' ');
+    Console::print_string(violations == 0 ? "OK" : "FAILED");
+    print_horizontal_line(35);
+}
+
+
+void Kernel::Tests::tickless_test() {
+    // Only the main thread sleeps, so with the tickless timer, there should be a few timer interrupts for the whole sleep, instead of one for every tick.
+    uint64 interrupts_before = 0, interrupts_after = 0;
+    for (uint64 i = 0; i < MAX_HARTS; ++i) {
+        interrupts_before += harts[i].n_timer_interrupts;
+    }
+
+    time_sleep(20);
+
+    for (uint64 i = 0; i < MAX_HARTS; ++i) {
+        interrupts_after += harts[i].n_timer_interrupts;
+    }
+
+    // Periodic timer would interrupt every hart on every tick, so even one hart would take 20 interrupts, the tickless one needs far fewer than that for all the harts together.
+    uint64 n_interrupts = interrupts_after - interrupts_before;
+    Console::print_string("TIMER INTERRUPTS DURING 20 TICKS OF SLEEP:", ' ');
+    Console::print_uint64(n_interrupts, ' ');
+    Console::print_string(n_interrupts < 20 ? "OK" : "FAILED");
+    print_horizontal_line(35);
+}
+
+
 namespace {
     struct SleepParams {
         const char* msg_1;
@@ -278,6 +1127,92 @@ void Kernel::Tests::periodic_thread_test() {
 }
 
 
+namespace {
+    class Job : public PeriodicThread {
+    public:
+        uint64 volatile activations;
+
+        Job(time_t period, time_t wcet) : PeriodicThread(period, wcet) {
+            this->activations = 0;
+        }
+
+    protected:
+        virtual void periodicActivation() override {
+            this->activations++;
+        }
+    };
+
+    // Job that runs for 3 ticks, while it declares only 1, so every one of its jobs has to be cut off at its WCET.
+    class OverrunningJob : public Job {
+    public:
+        OverrunningJob(time_t period, time_t wcet) : Job(period, wcet) { }
+
+    protected:
+        virtual void periodicActivation() override {
+            uint64 end = Kernel::Utils::read_mtime() + 3 * Kernel::Timer::TIMER_INTERVAL;
+            while (Kernel::Utils::read_mtime() < end) { }
+            this->activations++;
+        }
+    };
+
+    void cpu_hog(void* args) {
+        bool volatile* stop = (bool volatile*)args;
+        while (!*stop) { }
+    }
+
+    void print_job(const char* name, Job& job) {
+        Console::print_string(name, ' ');
+        Console::print_string(job.is_real_time() ? "ADMITTED, ACTIVATIONS:" : "NOT ADMITTED, ACTIVATIONS:", ' ');
+        Console::print_uint64(job.activations, ' ');
+        Console::print_string("MISSES:", ' ');
+        Console::print_uint64(job.get_deadline_misses());
+    }
+}
+
+void Kernel::Tests::edf_test() {
+    // Three real-time threads on hart 0 that take 25%, 34% and 25% of it, and a best effort thread that never blocks, the first two should still meet all of their deadlines.
+    // Third one runs for 3 ticks instead of the 1 tick it has declared, so all of its jobs are cut off (and missed), and it can't take the time of the other two.
+    bool volatile stop = false;
+    Thread hog(cpu_hog, (void*)&stop);
+    Job fast(4, 1), slow(6, 2);
+    OverrunningJob overrun(4, 1);
+    fast.set_affinity(1);
+    slow.set_affinity(1);
+    overrun.set_affinity(1);
+
+    hog.start();
+    fast.start();
+    slow.start();
+    overrun.start();
+    for (int i = 0; i < 10 && !(fast.is_real_time() && slow.is_real_time() && overrun.is_real_time()); ++i) {
+        time_sleep(1);
+    }
+
+    // Fourth real-time thread wants a whole hart, hart 0 doesn't have that much left, so it is admitted only if there is another hart.
+    Job greedy(2, 2);
+    greedy.start();
+    time_sleep(48);
+
+    fast.terminate();
+    slow.terminate();
+    overrun.terminate();
+    greedy.terminate();
+    stop = true;
+    hog.join();
+
+    print_job("FAST (T=4, C=1):", fast);
+    print_job("SLOW (T=6, C=2):", slow);
+    print_job("OVERRUNNING (T=4, C=1, RUNS 3):", overrun);
+    print_job("GREEDY (T=2, C=2):", greedy);
+
+    bool greedy_ok = greedy.is_real_time() == (MAX_HARTS > 1) && (!greedy.is_real_time() || greedy.get_deadline_misses() == 0);
+    Console::print_string("ADMISSIONS AND DEADLINES:", ' ');
+    Console::print_string(fast.is_real_time() && slow.is_real_time() && overrun.is_real_time() && greedy_ok &&
+                          fast.get_deadline_misses() == 0 && slow.get_deadline_misses() == 0 && overrun.get_deadline_misses() > 0 ? "OK" : "FAILED");
+    print_horizontal_line(35);
+}
+
+
 namespace {
     struct IOTestParams {
         Semaphore* io_mutex;
@@ -294,7 +1229,8 @@ namespace {
         Console::print_string(str);
         params->io_mutex->signal();
 
-        mem_free(str);
+        // The string was created with new, so it has to be deleted, not freed with mem_free.
+        delete[] str;
     }
 }
 
@@ -320,14 +1256,124 @@ void Kernel::Tests::console_io_test() {
 }
 
 
+namespace {
+    // Used by fp_test(), both FP threads run the same loop from their own seeds on the same hart, long enough to be preempted by each other several times.
+    constexpr uint64 FP_ROUNDS = 2000000;
+    constexpr int FP_THREADS = 2;
+    constexpr int INT_THREADS = 2;
+
+    struct FPParams {
+        double seed;
+        double result;
+        bool off_hart;
+    };
+
+    double fp_work(double seed) {
+        // The loop keeps its values in the FP registers, so if they weren't switched along with the thread (or the ones of the other thread were loaded), the result would be different.
+        double x = seed;
+        for (uint64 i = 0; i < FP_ROUNDS; ++i) {
+            x = x * 0.999999 + seed;
+        }
+        return x;
+    }
+
+    void fp_work_thread(void* args) {
+        // Thread is created with its mask, so it should be on hart 0 from the start, otherwise the threads wouldn't preempt each other.
+        FPParams* params = (FPParams*)args;
+        params->off_hart = thread_get_hart() != 0;
+        params->result = fp_work(params->seed);
+        params->off_hart = params->off_hart || thread_get_hart() != 0;
+    }
+
+    void int_work_thread(void*) {
+        for (int i = 0; i < 1000; ++i) {
+            thread_dispatch();
+        }
+    }
+
+    void run_pinned_threads(void (*body)(void*), FPParams* params, int n_threads) {
+        Thread* threads[FP_THREADS > INT_THREADS ? FP_THREADS : INT_THREADS];
+        for (int i = 0; i < n_threads; ++i) {
+            threads[i] = new Thread(body, params ? &params[i] : nullptr);
+            threads[i]->set_affinity(1);
+            threads[i]->start();
+        }
+
+        for (int i = 0; i < n_threads; ++i) {
+            threads[i]->join();
+            delete threads[i];
+        }
+    }
+
+    void count_fp_switches(uint64* restores, uint64* saves) {
+        *restores = *saves = 0;
+        for (uint64 i = 0; i < Kernel::MAX_HARTS; ++i) {
+            *restores += Kernel::harts[i].n_fp_restores;
+            *saves += Kernel::harts[i].n_fp_saves;
+        }
+    }
+}
+
+void Kernel::Tests::fp_test() {
+    // Expected results are computed by the main thread alone, then the same work is done by two threads that share hart 0.
+    FPParams params[FP_THREADS] = { { 1.5, 0, false }, { -2.25, 0, false } };
+    double expected[FP_THREADS];
+    for (int i = 0; i < FP_THREADS; ++i) {
+        expected[i] = fp_work(params[i].seed);
+    }
+
+    uint64 restores_before, saves_before, restores_after, saves_after;
+    count_fp_switches(&restores_before, &saves_before);
+    run_pinned_threads(fp_work_thread, params, FP_THREADS);
+    count_fp_switches(&restores_after, &saves_after);
+    bool results_ok = params[0].result == expected[0] && params[1].result == expected[1];
+
+    // Every thread loads its registers on its first FP instruction, any load above that is a thread that was preempted in the middle of its FP work, and came back to it.
+    bool switched_on_hart_0 = !params[0].off_hart && !params[1].off_hart && restores_after - restores_before > FP_THREADS;
+
+    Console::print_string("FP RESULTS OF PREEMPTED THREADS:", ' ');
+    Console::print_string(results_ok ? "OK" : "FAILED");
+    Console::print_string("FP THREADS SWITCHED ON HART 0:", ' ');
+    Console::print_string(switched_on_hart_0 ? "OK" : "FAILED");
+    Console::print_string("FP REGISTER LOADS / SAVES:", ' ');
+    Console::print_uint64(restores_after - restores_before, ' ');
+    Console::print_string("/", ' ');
+    Console::print_uint64(saves_after - saves_before);
+
+    // Threads that never touch the FP registers switch between each other without any FP load or save, nothing else uses FP in the meantime.
+    count_fp_switches(&restores_before, &saves_before);
+    run_pinned_threads(int_work_thread, nullptr, INT_THREADS);
+    count_fp_switches(&restores_after, &saves_after);
+
+    Console::print_string("INTEGER THREADS FP LOADS / SAVES:", ' ');
+    Console::print_string(restores_after == restores_before && saves_after == saves_before ? "NONE" : "FAILED");
+    print_horizontal_line(35);
+}
+
+
 void Kernel::Tests::run_tests() {
     memory_test();
+    memory_benchmark();
+    aligned_realloc_test();
+    cpp_arena_test();
+    slab_cache_test();
 
     threads_test();
     thread_exit_test();
     semaphore_test();
+    scheduler_test();
+    priority_test();
+    time_slice_test();
+    smp_benchmark();
+    context_switch_benchmark();
+    syscall_benchmark();
+    syscall_stats_test();
+    affinity_test();
+    tickless_test();
     time_sleep_test();
     periodic_thread_test();
+    edf_test();
+    fp_test();
 
     console_io_test();
 }
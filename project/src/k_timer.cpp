@@ -0,0 +1,112 @@
+#include "k_timer.hpp"
+#include "k_hart.hpp"
+#include "k_scheduler.hpp"
+#include "k_utils.hpp"
+
+namespace Kernel {
+    Timer& Timer::get_instance() {
+        static Timer timer;
+        return timer;
+    }
+
+    uint64 volatile* Timer::get_mtimecmp(uint64 hart_id) {
+        return (uint64 volatile*)(CLINT_MTIMECMP_ADDR + 8 * hart_id);
+    }
+
+    void Timer::arm(uint64 hart_id, uint64 deadline) {
+        // PMP lets the supervisor mode write to the CLINT, so we can program the timer of any hart. Deadline that has already passed is moved to now, as timervec of hw.lib adds TIMER_INTERVAL to mtimecmp once it fires.
+        // If mtimecmp stayed far in the past, the timer would keep interrupting the machine mode until mtimecmp catches up with mtime.
+        uint64 now = Utils::read_mtime();
+        *get_mtimecmp(hart_id) = (deadline < now) ? now : deadline;
+    }
+
+    uint64 Timer::get_sleep_deadline() {
+        // Sleeping threads are kept in the delta list, so the first thread wakes up after its own sleep_for ticks, and that is the earliest wake up of them all.
+        if (this->sleep_queue.is_empty()) {
+            return NO_DEADLINE;
+        }
+
+        time_t ticks_left = this->sleep_queue.get_first_sleep_for();
+        if (ticks_left > (NO_DEADLINE - this->sleep_last_tick) / TIMER_INTERVAL) {
+            return NO_DEADLINE;
+        }
+        return this->sleep_last_tick + ticks_left * TIMER_INTERVAL;
+    }
+
+    void Timer::initialize() {
+        // Ticks of every hart and of the sleeping threads are counted from now on.
+        uint64 now = Utils::read_mtime();
+        for (uint64 hart_id = 0; hart_id < MAX_HARTS; ++hart_id) {
+            harts[hart_id].last_tick = now;
+        }
+        this->sleep_last_tick = now;
+        this->boot_time = now;
+    }
+
+    time_t Timer::get_ticks() {
+        return (Utils::read_mtime() - this->boot_time) / TIMER_INTERVAL;
+    }
+
+    void Timer::update() {
+        uint64 now = Utils::read_mtime();
+
+        // Count only the whole ticks, the rest of the current tick is counted once it is over.
+        Hart& hart = get_hart();
+        time_t ticks = (now - hart.last_tick) / TIMER_INTERVAL;
+        if (ticks > 0) {
+            hart.last_tick += ticks * TIMER_INTERVAL;
+            hart.timer_ticks += ticks;
+            Scheduler::get_instance().timer_tick(ticks);
+        }
+
+        ticks = (now - this->sleep_last_tick) / TIMER_INTERVAL;
+        if (ticks > 0) {
+            this->sleep_last_tick += ticks * TIMER_INTERVAL;
+            this->sleep_queue.timer_tick(ticks);
+        }
+    }
+
+    void Timer::program() {
+        Hart& hart = get_hart();
+        TCB* tcb = hart.current_tcb;
+        uint64 deadline = NO_DEADLINE;
+
+        if (tcb && tcb->time_slice != Scheduler::UNBOUNDED_TIME_SLICE) {
+            // Time slice ends on the tick when timer_ticks reaches it, ticks are counted from the last tick of the hart. If that is too far away to fit into mtime, it is as good as unbounded.
+            time_t ticks_left = (tcb->time_slice > hart.timer_ticks) ? tcb->time_slice - hart.timer_ticks : 0;
+            if (ticks_left <= (NO_DEADLINE - hart.last_tick) / TIMER_INTERVAL) {
+                deadline = hart.last_tick + ticks_left * TIMER_INTERVAL;
+            }
+        }
+
+        if (hart.id == SLEEP_HART) {
+            uint64 sleep_deadline = this->get_sleep_deadline();
+            deadline = (sleep_deadline < deadline) ? sleep_deadline : deadline;
+        }
+
+        if (deadline == NO_DEADLINE) {
+            *get_mtimecmp(hart.id) = NO_DEADLINE;
+        }
+        else {
+            this->arm(hart.id, deadline);
+        }
+    }
+
+    void Timer::wake_hart(uint64 hart_id) {
+        this->arm(hart_id, 0);
+    }
+
+    void Timer::put_to_sleep(TCB* tcb, time_t ticks) {
+        // Ticks that have already passed are counted first, so that they are not counted against the new thread as well.
+        this->update();
+        this->sleep_queue.put_to_sleep(tcb, ticks);
+
+        // Thread may now be the first one to wake up, the sleep hart has to have its timer programmed for it. If it is this hart, it is programmed once the next thread starts running.
+        if (get_hart().id != SLEEP_HART) {
+            uint64 deadline = this->get_sleep_deadline();
+            if (deadline < *get_mtimecmp(SLEEP_HART)) {
+                this->arm(SLEEP_HART, deadline);
+            }
+        }
+    }
+}
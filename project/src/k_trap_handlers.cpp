@@ -1,16 +1,16 @@
 #include "k_trap_handlers.hpp"
 #include "k_syscall_codes.hpp"
-#include "k_tcb_sleep_queue.hpp"
+#include "k_syscall_table.hpp"
+#include "k_timer.hpp"
 #include "k_scheduler.hpp"
+#include "k_hart.hpp"
 #include "k_memory.hpp"
+#include "k_slab.hpp"
 #include "syscall_c.hpp"
 #include "queue.hpp"
 #include "k_utils.hpp"
 
 namespace Kernel {
-    // Queue in which we will store threads that requested to sleep for some time.
-    static TCBSleepQueue sleep_queue;
-
     // Buffer of characters that wait to be printed to the screen, and semaphore for it.
     static Queue<char, IO_BUFFER_SIZE> putc_buffer;
     Sem putc_sem;
@@ -25,16 +25,25 @@ namespace Kernel {
         __asm__ volatile ("csrr %[sts], sstatus" : [sts] "=r" (sstatus_val));
 
         // To bit of index 1 (SIE Software Interrupt Enable) of SSTATUS registry, write 0, so that we mask the interupts because of the critical section.
+        // The buffer is shared with the other harts as well, so we take the kernel lock, with the interrupts masked.
         __asm__ volatile ("csrc sstatus, 0x02");
+        lock_kernel();
 
+        int n_sent = 0;
         while (putc_buffer.get_length() > 0 && *((uint8*)CONSOLE_STATUS) & CONSOLE_TX_STATUS_BIT) {
             // As long as we have characters in buffer to flush, and as long as we can transmit (TX) char to the console, then take one char from the buffer.
-            // And write it to the CONSOLE_TX_DATA register that is memory mapped, therefore we can access it with pointer. And wake up one thread if there is one that is waiting to print.
+            // And write it to the CONSOLE_TX_DATA register that is memory mapped, therefore we can access it with pointer.
             *((char*)CONSOLE_TX_DATA) = putc_buffer.get();
-            putc_sem.signal();
+            n_sent++;
+        }
+
+        if (n_sent > 0) {
+            // Wake up the threads that wait to print, all at once, as there is space in the buffer for one more character for every character that was sent.
+            putc_sem.signal(n_sent);
         }
 
         // Write back the old value of sstatus. Unlock critical section.
+        unlock_kernel();
         __asm__ volatile ("csrw sstatus, %[sts]" : : [sts] "r" (sstatus_val));
     }
 
@@ -53,119 +62,459 @@ namespace Kernel {
         }
     }
 
+    // Handlers of the system calls, every one of them is in the system call table below, under its code. The ones that never switch threads are used by the fast path as well.
+    static bool mem_alloc_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        *result = (uint64)MemoryAllocator::get_instance().alloc(p0);
+        return true;
+    }
+
+    static bool mem_free_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        *result = MemoryAllocator::get_instance().free((void*)p0);
+        return true;
+    }
+
+    static bool slab_stats_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if ((slab_stats_t*)p1 && SlabCache::get_cache((int)p0)) {
+            // Copy the occupancy counters of the cache, only if such cache exists, and if we have location where to store them.
+            SlabCache* cache = SlabCache::get_cache((int)p0);
+            slab_stats_t* stats = (slab_stats_t*)p1;
+            stats->object_size = cache->get_object_size();
+            stats->objects_per_slab = cache->get_objects_per_slab();
+            stats->slabs = cache->get_slab_count();
+            stats->objects_used = cache->get_used_count();
+            stats->objects_free = stats->slabs * stats->objects_per_slab - stats->objects_used;
+            *result = SUCCESS_SYSCALL;
+        }
+        return true;
+    }
+
+    static bool mem_stats_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if ((mem_stats_t*)p0) {
+            // Copy the counters of the kernel heap, only if we have location where to store them. All of them are kept up to date by the allocator, so this takes constant time.
+            MemoryAllocator& mem_allocator = MemoryAllocator::get_instance();
+            mem_stats_t* stats = (mem_stats_t*)p0;
+            stats->bytes_used = (size_t)mem_allocator.get_used_blocks() * MEM_BLOCK_SIZE;
+            stats->bytes_free = (size_t)(mem_allocator.get_total_blocks() - mem_allocator.get_used_blocks()) * MEM_BLOCK_SIZE;
+            stats->free_extents = mem_allocator.get_free_extent_count();
+            stats->largest_free_extent = (size_t)mem_allocator.get_largest_free_extent() * MEM_BLOCK_SIZE;
+            stats->fragmentation = mem_allocator.get_fragmentation_index();
+            stats->allocs = mem_allocator.get_alloc_count();
+            stats->frees = mem_allocator.get_free_count();
+            stats->failed_allocs = mem_allocator.get_failed_alloc_count();
+            *result = SUCCESS_SYSCALL;
+        }
+        return true;
+    }
+
+    static bool mem_alloc_aligned_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        *result = (uint64)MemoryAllocator::get_instance().alloc_aligned(p0, p1);
+        return true;
+    }
+
+    static bool mem_realloc_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        *result = (uint64)MemoryAllocator::get_instance().realloc((void*)p0, p1);
+        return true;
+    }
+
+    static bool thread_create_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        // Attributes are checked before anything is created, so that the thread is created only if all of them can be applied.
+        thread_attr_t* attr = (thread_attr_t*)p4;
+        if (attr && (attr->priority < 0 || attr->priority >= Scheduler::N_PRIORITIES || !(attr->affinity & ALL_HARTS_MASK))) {
+            return true;
+        }
+
+        if ((_thread**)p0) {
+            // Create new thread, only if you have location where to store the handle of it.
+            // Its attributes are applied before it is put to the scheduler, as once it is there, it may run right away (on this hart, or on another one).
+            TCB* tcb = create_tcb((void (*)(void*))p1, (void*)p2, (uint64*)p3);
+            *((_thread**)p0) = (_thread*)tcb;
+            if (tcb) {
+                if (attr) {
+                    Scheduler::get_instance().set_priority(tcb, attr->priority);
+                    Scheduler::get_instance().set_time_slice(tcb, attr->time_slice);
+                    Scheduler::get_instance().set_affinity(tcb, attr->affinity);
+                }
+                Scheduler::get_instance().put_tcb(tcb);
+                *result = SUCCESS_SYSCALL;
+            }
+        }
+        return true;
+    }
+
+    static bool thread_exit_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if (get_current_tcb() != &main_tcb) {
+            get_current_tcb()->status = TCBStatus::TERMINATING;
+            *result = SUCCESS_SYSCALL;
+            dispatch();
+        }
+        return true;
+    }
+
+    static bool thread_dispatch_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        // Since dispatch system call returns void, it really doesn't matter what the result is.
+        dispatch();
+        return true;
+    }
+
+    static bool thread_join_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if ((TCB*)p0 && ((TCB*)p0)->join_sem) {
+            // In case we have pointer to the TCB, and if it has its semaphore, then perform wait on that semaphore.
+            ((TCB*)p0)->join_sem->wait();
+        }
+        return true;
+    }
+
+    static bool thread_set_priority_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        TCB* tcb = get_live_tcb((TCB*)p0);
+        if (tcb && Scheduler::get_instance().set_priority(tcb, (int)p1) == Scheduler::PRIORITY_SUCCESS) {
+            *result = SUCCESS_SYSCALL;
+            if (tcb == get_current_tcb()) {
+                // The running thread may have lowered its own priority below some ready thread, so let the scheduler pick again.
+                dispatch();
+            }
+        }
+        return true;
+    }
+
+    static bool thread_get_priority_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        TCB* tcb = get_live_tcb((TCB*)p0);
+        if (tcb) {
+            *result = tcb->priority;
+        }
+        return true;
+    }
+
+    static bool thread_set_time_slice_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        TCB* tcb = get_live_tcb((TCB*)p0);
+        if (tcb) {
+            *result = Scheduler::get_instance().set_time_slice(tcb, (time_t)p1);
+        }
+        return true;
+    }
+
+    static bool set_default_time_slice_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        *result = Scheduler::get_instance().set_default_time_slice((time_t)p0);
+        return true;
+    }
+
+    static bool sched_stats_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if ((sched_stats_t*)p0) {
+            // Copy the load balancing counters of the scheduler, only if we have location where to store them.
+            sched_stats_t* stats = (sched_stats_t*)p0;
+            stats->harts = MAX_HARTS;
+            stats->steals = Scheduler::get_instance().get_steal_count();
+            stats->migrations = Scheduler::get_instance().get_migration_count();
+            *result = SUCCESS_SYSCALL;
+        }
+        return true;
+    }
+
+    static bool thread_set_periodic_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        TCB* tcb = get_live_tcb((TCB*)p0);
+        if (!tcb) {
+            return true;
+        }
+
+        *result = Scheduler::get_instance().set_real_time(tcb, (time_t)p1, (time_t)p2, (time_t)p3);
+        if (tcb == get_current_tcb()) {
+            // The calling thread may now be ahead of (or behind) the other threads, or it may have been moved to another hart, so let the scheduler pick again.
+            dispatch();
+        }
+        return true;
+    }
+
+    static bool thread_wait_next_period_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if (Scheduler::is_real_time(get_current_tcb())) {
+            // End the current job, and sleep until the next one is released (in case it isn't already), the thread gets back how many deadlines it has missed so far.
+            time_t release_ticks = Scheduler::get_instance().end_real_time_job(get_current_tcb());
+            *result = get_current_tcb()->rt_misses;
+            if (release_ticks > 0) {
+                Timer::get_instance().put_to_sleep(get_current_tcb(), release_ticks);
+            }
+            dispatch();
+        }
+        return true;
+    }
+
+    static bool thread_get_deadline_misses_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        TCB* tcb = get_live_tcb((TCB*)p0);
+        if (tcb) {
+            *result = tcb->rt_misses;
+        }
+        return true;
+    }
+
+    static bool thread_set_affinity_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        TCB* tcb = get_live_tcb((TCB*)p0);
+        if (!tcb) {
+            return true;
+        }
+
+        *result = Scheduler::get_instance().set_affinity(tcb, p1);
+        if (tcb == get_current_tcb() && !(tcb->affinity >> tcb->hart & 1)) {
+            // The calling thread is no longer allowed on this hart, so it moves to one of its new harts right away.
+            dispatch();
+        }
+        return true;
+    }
+
+    static bool thread_get_hart_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        *result = get_current_tcb()->hart;
+        return true;
+    }
+
+    static bool sem_open_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if ((_sem**)p0) {
+            // Create semaphore only if you have location to which to save the handle of it.
+            *(_sem**)p0 = (_sem*)Sem::create_sem((int)p1);
+            if (*(_sem**)p0) {
+                *result = SUCCESS_SYSCALL;
+            }
+        }
+        return true;
+    }
+
+    static bool sem_close_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if ((Sem*)p0) {
+            int close_result = ((Sem*)p0)->close();
+            if (Sem::free_sem((Sem*)p0) == MemoryAllocator::MEM_SUCCESS) {
+                *result = close_result;
+            }
+        }
+        return true;
+    }
+
+    static bool sem_wait_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if ((Sem*)p0) {
+            *result = ((Sem*)p0)->wait();
+        }
+        return true;
+    }
+
+    static bool sem_try_wait_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        // The fast path takes the semaphore only if it can do that right away, otherwise the full path blocks the thread on it.
+        if (!(Sem*)p0 || !((Sem*)p0)->try_wait()) {
+            return false;
+        }
+        *result = Sem::WAIT_SUCCESS;
+        return true;
+    }
+
+    static bool sem_signal_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if ((Sem*)p0) {
+            *result = ((Sem*)p0)->signal();
+        }
+        return true;
+    }
+
+    static bool time_sleep_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        if (p0 > 0) {
+            // Sleep the current thread, but only if number of ticks to sleep for are greater than 0, and switch to different thread.
+            Timer::get_instance().put_to_sleep(get_current_tcb(), p0);
+            *result = SUCCESS_SYSCALL;
+            dispatch();
+        }
+        return true;
+    }
+
+    static bool getc_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        getc_sem.wait();
+        *result = getc_buffer.get();
+        return true;
+    }
+
+    static bool putc_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        putc_sem.wait();
+        putc_buffer.put((char)p0);
+
+        // If the console is ready, the character is sent right away. Otherwise, the console interrupts us once it has sent what it has, and the rest is sent from there.
+        flush_putc_buffer();
+        return true;
+    }
+
+    static bool syscall_stats_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4);
+
+    static bool user_mode_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        prepare_user_mode();
+        *result = SUCCESS_SYSCALL;
+        return true;
+    }
+
+    // System call table, the row is the high nibble of the system call code, and the column is the low nibble of it. Every system call that never switches threads has a fast handler as well.
+    constexpr static SyscallEntry syscall_table[SYSCALL_GROUPS][SYSCALLS_PER_GROUP] = {
+        {
+            { },
+            { "mem_alloc", mem_alloc_handler, mem_alloc_handler },
+            { "mem_free", mem_free_handler, mem_free_handler },
+            { "slab_stats", slab_stats_handler, slab_stats_handler },
+            { "mem_stats", mem_stats_handler, mem_stats_handler },
+            { "mem_alloc_aligned", mem_alloc_aligned_handler, mem_alloc_aligned_handler },
+            { "mem_realloc", mem_realloc_handler, mem_realloc_handler }
+        },
+        {
+            { },
+            { "thread_create", thread_create_handler, nullptr },
+            { "thread_exit", thread_exit_handler, nullptr },
+            { "thread_dispatch", thread_dispatch_handler, nullptr },
+            { "thread_join", thread_join_handler, nullptr },
+            { "thread_set_priority", thread_set_priority_handler, nullptr },
+            { "thread_get_priority", thread_get_priority_handler, thread_get_priority_handler },
+            { "thread_set_time_slice", thread_set_time_slice_handler, nullptr },
+            { "thread_set_default_time_slice", set_default_time_slice_handler, nullptr },
+            { "sched_stats", sched_stats_handler, sched_stats_handler },
+            { "thread_set_periodic", thread_set_periodic_handler, nullptr },
+            { "thread_wait_next_period", thread_wait_next_period_handler, nullptr },
+            { "thread_get_deadline_misses", thread_get_deadline_misses_handler, thread_get_deadline_misses_handler },
+            { "thread_set_affinity", thread_set_affinity_handler, nullptr },
+            { "thread_get_hart", thread_get_hart_handler, thread_get_hart_handler }
+        },
+        {
+            { },
+            { "sem_open", sem_open_handler, nullptr },
+            { "sem_close", sem_close_handler, nullptr },
+            { "sem_wait", sem_wait_handler, sem_try_wait_handler },
+            { "sem_signal", sem_signal_handler, sem_signal_handler }
+        },
+        {
+            { },
+            { "time_sleep", time_sleep_handler, nullptr }
+        },
+        {
+            { },
+            { "getc", getc_handler, nullptr },
+            { "putc", putc_handler, nullptr }
+        },
+        {
+            { },
+            { "syscall_stats", syscall_stats_handler, syscall_stats_handler }
+        },
+        { }, { }, { }, { }, { }, { }, { }, { }, { },
+        {
+            { }, { }, { }, { }, { }, { }, { }, { }, { }, { }, { }, { }, { }, { }, { },
+            { "set_user_mode", user_mode_handler, nullptr }
+        }
+    };
+
+    static const SyscallEntry* get_syscall_entry(uint64 syscall_code) {
+        if (syscall_code >= SYSCALL_TABLE_SIZE || !syscall_table[syscall_code / SYSCALLS_PER_GROUP][syscall_code % SYSCALLS_PER_GROUP].handler) {
+            return nullptr;
+        }
+        return &syscall_table[syscall_code / SYSCALLS_PER_GROUP][syscall_code % SYSCALLS_PER_GROUP];
+    }
+
+#if SYSCALL_STATS == 1
+    SyscallStatsEnabled::Counters SyscallStatsEnabled::counters[SYSCALL_TABLE_SIZE];
+#endif
+
+    static bool syscall_stats_handler(uint64* result, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4) {
+        // Walk through the whole table, copy the statistics of as many system calls as there is space for, and count all of them.
+        syscall_stats_t* stats = (syscall_stats_t*)p0;
+        uint64 n_syscalls = 0;
+        for (uint64 code = 0; code < SYSCALL_TABLE_SIZE; ++code) {
+            const SyscallEntry* entry = get_syscall_entry(code);
+            if (!entry) {
+                continue;
+            }
+
+            if (stats && n_syscalls < p1) {
+                stats[n_syscalls].code = code;
+                stats[n_syscalls].name = entry->name;
+                stats[n_syscalls].fast_path = entry->fast_handler ? 1 : 0;
+                Syscalls::read_stats(code, &stats[n_syscalls]);
+            }
+            n_syscalls++;
+        }
+
+        *result = n_syscalls;
+        return true;
+    }
+
+    // Fast path of the non-blocking system calls is on by default.
+    bool fast_syscalls = true;
+
+    // FP registers of the thread that are loaded when no thread has used them yet.
+    static FPContext initial_fp_context;
+
+    static bool handle_fp_trap() {
+        // Thread has FP turned off (FS is Off) whenever it is switched to, so its first FP instruction after that is an illegal instruction, its FP registers are loaded then and the instruction is run again.
+        // In case FS is already on, the instruction is illegal for some other reason, which is left to the full path. So is an illegal instruction with FS Off, once it traps again with FS on.
+        uint64 sstatus_val;
+        __asm__ volatile("csrr %0, sstatus" : "=r" (sstatus_val));
+        if ((sstatus_val & SSTATUS_FS) != SSTATUS_FS_OFF) {
+            return false;
+        }
+
+        // FS has to be on for the loads, the registers are the same as in the save area of the thread after them (Clean). Thread that uses FP for the first time gets zeroed registers.
+        // Its save area is not valid yet, so its registers are Dirty, and they are saved once it is switched away from, even if it doesn't change them.
+        TCB* tcb = get_current_tcb();
+        uint64 fs_val = tcb->fp_used ? SSTATUS_FS_CLEAN : SSTATUS_FS_DIRTY;
+        __asm__ volatile("csrs sstatus, %0" : : "r" (SSTATUS_FS_CLEAN));
+        k_restore_fp_context(tcb->fp_used ? &tcb->fp_context : &initial_fp_context);
+        __asm__ volatile("csrc sstatus, %0" : : "r" (SSTATUS_FS));
+        __asm__ volatile("csrs sstatus, %0" : : "r" (fs_val));
+
+        tcb->fp_used = true;
+        get_hart().n_fp_restores++;
+        return true;
+    }
+
+    extern "C" int k_handle_fast_ecall(uint64 syscall_code, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4, uint64 p5, uint64 p6) {
+        // Only the caller-saved registers of the thread are saved at this point, so nothing here may switch threads, or read the other registers from the context.
+        uint64 volatile scause_val;
+        __asm__ volatile("csrr %0, scause" : "=r" (scause_val));
+        if (scause_val == SCAUSE_ILLEGAL_INSTRUCTION) {
+            // The fast path returns with the SSTATUS and SEPC registers, so the thread runs the FP instruction again, with the FS that was set here.
+            return handle_fp_trap() ? 1 : 0;
+        }
+
+        if (!fast_syscalls || (scause_val != SCAUSE_ECALL_USER && scause_val != SCAUSE_ECALL_SUPERVISOR)) {
+            return 0;
+        }
+
+        const SyscallEntry* entry = get_syscall_entry(syscall_code);
+        if (!entry || !entry->fast_handler) {
+            return 0;
+        }
+
+        lock_kernel();
+        uint64 result = FAILED_SYSCALL;
+        bool handled = Syscalls::call(syscall_code, *entry, true, &result, p0, p1, p2, p3, p4);
+        if (handled) {
+            // Return to the instruction after ecall, the fast path returns with the SEPC register, not with the one in the context.
+            uint64 sepc_val;
+            get_current_context()->a0 = result;
+            __asm__ volatile("csrr %0, sepc" : "=r" (sepc_val));
+            __asm__ volatile("csrw sepc, %0" : : "r" (sepc_val + INSTRUCTION_SIZE));
+        }
+        unlock_kernel();
+        return handled ? 1 : 0;
+    }
+
     extern "C" void k_handle_ecall(uint64 syscall_code, uint64 p0, uint64 p1, uint64 p2, uint64 p3, uint64 p4, uint64 p5, uint64 p6) {
         // Read current SCAUSE (SuperVisor Cause) and SEPC (SuperVisor Exception Program Counter).
-        uint64 volatile scause_val, sepc_val, temp_val;
+        uint64 volatile scause_val, sepc_val;
         __asm__ volatile("csrr %0, scause" : "=r" (scause_val));
         __asm__ volatile("csrr %0, sepc" : "=r" (sepc_val));
+        lock_kernel();
 
         if (scause_val == SCAUSE_ECALL_USER || scause_val == SCAUSE_ECALL_SUPERVISOR) {
             // SEPC contains address of ecall (points to the ecall instruction), so increment it by the size of the instruction to point to the instruction after ecall.
             // If we didn't do this, we would be basically stuck in an infinite loop. As after returning from ecall trap, we would again jump right into it.
+            // The trap returns with the SEPC that is in the context of the thread, the trap entry has saved it there.
             sepc_val += INSTRUCTION_SIZE;
-            __asm__ volatile ("csrw sepc, %0" : : "r" (sepc_val));
+            get_current_context()->sepc = sepc_val;
 
             // In SIP (SuperVisor Interrupt Pending) registry, to the 2nd bit SSIP (SuperVisor Software Interrput Pending) write 0, with that we say we handled the software interrupt.
             __asm__ volatile("csrc sip, 0x02");
 
-            // At the start, we assume that the system call has failed. If it didn't, we will later write the code of success.
-            k_current_context->a0 = FAILED_SYSCALL;
-
-            switch (syscall_code) {
-                case MEM_ALLOC_CODE:
-                    k_current_context->a0 = (uint64)MemoryAllocator::get_instance().alloc(p0);
-                    break;
-
-                case MEM_FREE_CODE:
-                    k_current_context->a0 = MemoryAllocator::get_instance().free((void*)p0);
-                    break;
-
-                case CREATE_THREAD_CODE:
-                    if ((_thread**)p0) {
-                        // Create new thread, only if you have location where to store the handle of it.
-                        *((_thread**)p0) = (_thread*)create_tcb((void (*)(void*))p1, (void*)p2, (uint64*)p3);
-                        if (*((_thread**)p0)) {
-                            Scheduler::get_instance().put_tcb(*((TCB**)p0));
-                            k_current_context->a0 = SUCCESS_SYSCALL;
-                        }
-                    }
-                    break;
-
-                case THREAD_EXIT_CODE:
-                    if (current_tcb != &main_tcb) {
-                        current_tcb->status = TCBStatus::TERMINATING;
-                        k_current_context->a0 = SUCCESS_SYSCALL;
-                        dispatch();
-                    }
-                    break;
-
-                case THREAD_DISPATCH_CODE:
-                    // Since dispatch system call returns void, we won't change the a0 register value, it really doesn't matter what it has.
-                    dispatch();
-                    break;
-
-                case THREAD_JOIN_CODE:
-                    if ((TCB*)p0 && ((TCB*)p0)->join_sem) {
-                        // In case we have pointer to the TCB, and if it has its semaphore, then perform wait on that semaphore.
-                        ((TCB*)p0)->join_sem->wait();
-                    }
-                    break;
-
-                case SEM_OPEN_CODE:
-                    if ((_sem**)p0) {
-                        // Create semaphore only if you have location to which to save the handle of it.
-                        *(_sem**)p0 = (_sem*)Sem::create_sem((int)p1);
-                        if (*(_sem**)p0) {
-                            k_current_context->a0 = SUCCESS_SYSCALL;
-                        }
-                    }
-                    break;
-
-                case SEM_CLOSE_CODE:
-                    if ((Sem*)p0) {
-                        temp_val = ((Sem*)p0)->close();
-                        if (Sem::free_sem((Sem*)p0) == MemoryAllocator::MEM_SUCCESS) {
-                            k_current_context->a0 = temp_val;
-                        }
-                    }
-                    break;
-
-                case SEM_WAIT_CODE:
-                    if ((Sem*)p0) {
-                        k_current_context->a0 = ((Sem*)p0)->wait();
-                    }
-                    break;
-
-                case SEM_SIGNAL_CODE:
-                    if ((Sem*)p0) {
-                        k_current_context->a0 = ((Sem*)p0)->signal();
-                    }
-                    break;
-
-                case TIME_SLEEP_CODE:
-                    if (p0 > 0) {
-                        // Sleep the current thread, but only if number of ticks to sleep for are greater than 0, and switch to different thread.
-                        sleep_queue.put_to_sleep(current_tcb, p0);
-                        k_current_context->a0 = SUCCESS_SYSCALL;
-                        dispatch();
-                    }
-                    break;
-
-                case GET_C_CODE:
-                    getc_sem.wait();
-                    k_current_context->a0 = getc_buffer.get();
-                    break;
-
-                case PUT_C_CODE:
-                    putc_sem.wait();
-                    putc_buffer.put((char)p0);
-                    break;
-
-                case USER_MODE_CODE:
-                    prepare_user_mode();
-                    k_current_context->a0 = SUCCESS_SYSCALL;
-                    break;
+            // At the start, we assume that the system call has failed. If it didn't, the handler writes the result, which goes to the context once the thread is back from the handler.
+            // Thread may have switched to other threads in the handler, and come back on another hart, the context that we write to is still its own.
+            uint64 result = FAILED_SYSCALL;
+            const SyscallEntry* entry = get_syscall_entry(syscall_code);
+            if (entry) {
+                Syscalls::call(syscall_code, *entry, false, &result, p0, p1, p2, p3, p4);
             }
+            get_current_context()->a0 = result;
         }
         else if (scause_val == SCAUSE_ILLEGAL_INSTRUCTION || scause_val == SCAUSE_LOAD_ACCESS_FAULT || scause_val == SCAUSE_STORE_AMO_ACCESS_FAULT){
             // Empty everything that we have in putc buffer to the console. Because we want to use it.
@@ -198,24 +547,35 @@ namespace Kernel {
             // Now be stuck, forever, the user has to restart the machine.
             while(true);
         }
+
+        unlock_kernel();
     }
 
     extern "C" void k_handle_timer(uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64 a4, uint64 a5, uint64 a6, uint64 a7) {
         // In SIP register, write to the 2nd bit SSIP (SuperVisor Software Interrupt Pending) 0, with that we say that we handled the software interrupt.
         __asm__ volatile("csrc sip, 0x02");
+        lock_kernel();
 
-        // Check if there is a thread that needs to be woken up.
-        sleep_queue.timer_tick();
+        // Count all the ticks that have passed since the last time, which also wakes up the threads whose sleep is over. Timer interrupts are not periodic, so that may be more than one tick.
+        Timer& timer = Timer::get_instance();
+        get_hart().n_timer_interrupts++;
+        timer.update();
 
-        // Increment the timer tick as well, in case the time slice of the current thread has expired, then try switching to another thread.
-        if (++timer_ticks >= current_tcb->time_slice) {
+        // In case the time slice of the current thread has expired, then try switching to another thread, which programs the timer for that thread. Otherwise program it for the same thread again.
+        if (get_hart().timer_ticks >= get_current_tcb()->time_slice) {
             dispatch();
         }
+        else {
+            timer.program();
+        }
+
+        unlock_kernel();
     }
 
     extern "C" void k_handle_console(uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64 a4, uint64 a5, uint64 a6, uint64 a7) {
         // Grab the interrupt entry number.
         int irq = plic_claim();
+        lock_kernel();
 
         // To 9-th bit SEIP (SuperVisor External Interupt Pending) write 0, in SIP registry, with that we say that we did handle the hardware interrupt.
         __asm__ volatile("csrc sip, %0" : : "r" (0x200));
@@ -223,18 +583,20 @@ namespace Kernel {
         // Tell the PLIC (platform level interrupt controller), that the interrupt has been handled, so that it won't interrupt us again for it.
         plic_complete(irq);
 
-        // Handle the console input, since we were interrupted.
-        fill_getc_buffer();
+        if (irq == CONSOLE_IRQ) {
+            // Reading IIR tells the console that we have seen its interrupt, in case it was the one that says that the console can take more characters to transmit.
+            // Send as many of the waiting characters as the console can take now, and then handle the console input.
+            (void)*((uint8 volatile*)(CONSOLE_TX_DATA + CONSOLE_IIR_OFFSET));
+            flush_putc_buffer();
+            fill_getc_buffer();
+        }
+        unlock_kernel();
     }
 
 
     void prepare_user_mode() {
-        // Read sstatus.
-        uint64 volatile sstatus_val;
-        __asm__ volatile ("csrr %[sts], sstatus" : [sts] "=r" (sstatus_val));
-
-        // Set the 8-th bit to 0, which represents previous mode (now it's user mode), with sret we go back to the previous mode.
+        // Set the 8-th bit of the sstatus (in the context of the thread, which the trap returns with) to 0, which represents previous mode (now it's user mode), with sret we go back to the previous mode.
         // We set the 8-th bit to 0, by creating a ...00010000000 mask and inverting it to be ...11101111111.
-        __asm__ volatile("csrw sstatus, %[sts]" : : [sts] "r" (sstatus_val & ~(1 << 8)));
+        get_current_context()->sstatus &= ~(1UL << 8);
     }
 }
\ No newline at end of file
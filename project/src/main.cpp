@@ -1,7 +1,9 @@
 #include "k_trap_handlers.hpp"
 #include "k_tests.hpp"
-#include "k_memory.hpp"
+#include "k_slab.hpp"
 #include "k_scheduler.hpp"
+#include "k_hart.hpp"
+#include "k_timer.hpp"
 #include "syscall_c.hpp"
 #include "syscall_cpp.hpp"
 #include "k_utils.hpp"
@@ -36,8 +38,14 @@ void main() {
     // Set the address of the interupt table, and enable vector interupt mode (so that we can have multiple entries inside of it, we do that by performing binary OR operation with 1 and the address).
     __asm__ volatile ("csrw stvec, %0" : : "r" ((uint64)k_intr_table | 1));
 
+    // Let the user mode read the cycle, time and instret counters as well, so that the threads can measure themselves (the machine mode already allows it to us in k_entry).
+    __asm__ volatile ("csrw scounteren, %0" : : "r" (0x7));
+
+    // The sscratch register always points to the context of the thread that runs on the hart, the trap handlers find it there, at first that is the main thread.
+    __asm__ volatile ("csrw sscratch, %0" : : "r" (&main_tcb.context));
+
     // Create kernel stack for the main thread for the sake of completeness, and set the SP to point to the &sys_stack[last_index + 1], due to the nature of how RISC V stack behaves.
-    main_tcb.sys_stack = (uint64*)MemoryAllocator::get_instance().alloc(Utils::to_blocks(DEFAULT_STACK_SIZE));
+    main_tcb.sys_stack = (uint64*)SlabCache::get_cache(SlabCache::STACK_CACHE)->alloc();
     main_tcb.context.sys_sp = (uint64)&main_tcb.sys_stack[DEFAULT_STACK_SIZE / sizeof(uint64)];
 
     // Initialize the semaphores for console buffers. At the start we can exeucte putc IO_BUFFER_SIZE times since it is empty.
@@ -45,8 +53,12 @@ void main() {
     putc_sem.initialize(IO_BUFFER_SIZE);
     getc_sem.initialize(0);
 
-    // Initialize the Scheduler, which also creates internal putc thread, that flushes the console.
+    // Console output is sent from the interrupt handler, so the console has to interrupt us once it can take more characters, and not only when it has received one.
+    *((uint8*)(CONSOLE_TX_DATA + CONSOLE_IER_OFFSET)) = CONSOLE_IER_RX_TX;
+
+    // Initialize the Scheduler, which also creates the idle threads of the harts, and start counting the ticks.
     Scheduler::get_instance().initialize();
+    Timer::get_instance().initialize();
 
     // Set the bit with index 1 (SSIE SuperVisor Software Interrupt Enable) and with index 9 (SEIE Supervisor External Interrupt Enable).
     // This way we will enable software/external interrupts in supervisor mode (basically meaning they aren't masked out).
@@ -55,6 +67,9 @@ void main() {
     // In sstatus registry, set the bit with index 1 (SIE, SuperVisor Interrupt Enable), so that we can enable all interrupts.
     __asm__ volatile ("csrs sstatus, 0x02");
 
+    // Kernel is initialized, so the other harts can start running threads as well.
+    release_harts();
+
 #if RUN_KERNEL_TESTS == 1
     Kernel::Tests::run_tests();
 #endif
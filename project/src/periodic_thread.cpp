@@ -1,18 +1,36 @@
 #include "syscall_cpp.hpp"
 
-PeriodicThread::PeriodicThread(time_t period) 
+PeriodicThread::PeriodicThread(time_t period, time_t wcet, time_t deadline) 
     : Thread(
         [](void* t) {
-            // Repeatedly run the periodicActivation in case the period at which it should be run is greater than zero, and then sleep for the given period.
             PeriodicThread* p_thr = (PeriodicThread*)t;
-            while (p_thr && p_thr->period > 0) {
+            if (!p_thr) {
+                return;
+            }
+
+            // Thread joins the real-time class from its own body, so that its first job is released once it actually runs.
+            p_thr->real_time = p_thr->wcet > 0 && p_thr->period > 0 && thread_set_periodic(nullptr, p_thr->period, p_thr->deadline, p_thr->wcet) == 0;
+
+            // Repeatedly run the periodicActivation in case the period at which it should be run is greater than zero, and then wait for the next period.
+            while (p_thr->period > 0) {
                 p_thr->periodicActivation();
-                time_sleep(p_thr->period);
+                if (p_thr->real_time) {
+                    // Kernel releases the next job at the start of the next period, so the activations don't drift, no matter how long each of them took.
+                    int misses = thread_wait_next_period();
+                    p_thr->deadline_misses = (misses >= 0) ? misses : p_thr->deadline_misses;
+                }
+                else {
+                    time_sleep(p_thr->period);
+                }
             }
         }, 
         this
     ) {
     this->period = period;
+    this->deadline = deadline;
+    this->wcet = wcet;
+    this->real_time = false;
+    this->deadline_misses = 0;
 }
 
 void PeriodicThread::terminate() {
@@ -22,3 +40,11 @@ void PeriodicThread::terminate() {
     this->period = (time_t)0;
     this->join();
 }
+
+bool PeriodicThread::is_real_time() {
+    return this->real_time;
+}
+
+int PeriodicThread::get_deadline_misses() {
+    return this->deadline_misses;
+}
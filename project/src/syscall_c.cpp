@@ -16,8 +16,42 @@ int mem_free(void* address) {
     return (int)k_system_call(Kernel::MEM_FREE_CODE, (uint64)address);
 }
 
+void* mem_alloc_aligned(size_t size, size_t alignment) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return nullptr;
+    }
+
+    // Every allocation is already aligned to the block size, so only bigger alignments have to be passed as the number of blocks.
+    size_t align_blocks = (alignment > MEM_BLOCK_SIZE) ? alignment / MEM_BLOCK_SIZE : 1;
+    return (void*)k_system_call(Kernel::MEM_ALLOC_ALIGNED_CODE, Kernel::Utils::to_blocks(size), align_blocks);
+}
+
+void* mem_realloc(void* address, size_t size) {
+    return (void*)k_system_call(Kernel::MEM_REALLOC_CODE, (uint64)address, Kernel::Utils::to_blocks(size));
+}
+
+int slab_stats(int cache, slab_stats_t* stats) {
+    if (stats) {
+        // Read the counters of the cache, only if we have location where to store them.
+        return (int)k_system_call(Kernel::SLAB_STATS_CODE, (uint64)cache, (uint64)stats);
+    }
+    return Kernel::FAILED_SYSCALL;
+}
+
+int mem_stats(mem_stats_t* stats) {
+    if (stats) {
+        // Read the counters of the kernel heap, only if we have location where to store them.
+        return (int)k_system_call(Kernel::MEM_STATS_CODE, (uint64)stats);
+    }
+    return Kernel::FAILED_SYSCALL;
+}
+
 
 int thread_create(thread_t* handle, void (*start_routine)(void*), void* arg) {
+    return thread_create_attr(handle, start_routine, arg, nullptr);
+}
+
+int thread_create_attr(thread_t* handle, void (*start_routine)(void*), void* arg, const thread_attr_t* attr) {
     // Assume at the start that the system call has failed.
     int result_code = Kernel::FAILED_SYSCALL;
 
@@ -31,7 +65,7 @@ int thread_create(thread_t* handle, void (*start_routine)(void*), void* arg) {
             // If we think of stack as an array of uint64 elements, the address we pass to the system call, is address of stack[last_index + 1] basically.
             // And the reason for that, is because in RISC V, the stack grows downward (so address decreases), and SP (stack pointer) always points to already used memory location (full location).
             // Now initially we don't have anything used, and that's why we use &stack[last_index + 1], so once we do allocate location on stack, we will have sp = &stack[last_index].
-            result_code = (int)k_system_call(Kernel::CREATE_THREAD_CODE, (uint64)handle, (uint64)start_routine, (uint64)arg, (uint64)&stack_space[DEFAULT_STACK_SIZE / sizeof(uint64)]);
+            result_code = (int)k_system_call(Kernel::CREATE_THREAD_CODE, (uint64)handle, (uint64)start_routine, (uint64)arg, (uint64)&stack_space[DEFAULT_STACK_SIZE / sizeof(uint64)], (uint64)attr);
         }
     }
 
@@ -53,6 +87,59 @@ void thread_join(thread_t handle) {
     }
 }
 
+int thread_set_priority(thread_t handle, int priority) {
+    if (priority >= THREAD_PRIORITY_HIGHEST && priority <= THREAD_PRIORITY_LOWEST) {
+        // Change the priority, only if it is in the valid range.
+        return (int)k_system_call(Kernel::THREAD_SET_PRIORITY_CODE, (uint64)handle, (uint64)priority);
+    }
+    return Kernel::FAILED_SYSCALL;
+}
+
+int thread_get_priority(thread_t handle) {
+    return (int)k_system_call(Kernel::THREAD_GET_PRIORITY_CODE, (uint64)handle);
+}
+
+int thread_set_time_slice(thread_t handle, time_t ticks) {
+    return (int)k_system_call(Kernel::THREAD_SET_TIME_SLICE_CODE, (uint64)handle, (uint64)ticks);
+}
+
+int thread_set_default_time_slice(time_t ticks) {
+    if (ticks > 0) {
+        // Change the default time slice, only if it lasts at least 1 timer tick.
+        return (int)k_system_call(Kernel::SET_DEFAULT_TIME_SLICE_CODE, (uint64)ticks);
+    }
+    return Kernel::FAILED_SYSCALL;
+}
+
+int sched_stats(sched_stats_t* stats) {
+    if (stats) {
+        // Read the load balancing counters, only if we have location where to store them.
+        return (int)k_system_call(Kernel::SCHED_STATS_CODE, (uint64)stats);
+    }
+    return Kernel::FAILED_SYSCALL;
+}
+
+
+int thread_set_periodic(thread_t handle, time_t period, time_t deadline, time_t wcet) {
+    return (int)k_system_call(Kernel::THREAD_SET_PERIODIC_CODE, (uint64)handle, (uint64)period, (uint64)deadline, (uint64)wcet);
+}
+
+int thread_wait_next_period() {
+    return (int)k_system_call(Kernel::THREAD_WAIT_NEXT_PERIOD_CODE);
+}
+
+int thread_get_deadline_misses(thread_t handle) {
+    return (int)k_system_call(Kernel::THREAD_GET_DEADLINE_MISSES_CODE, (uint64)handle);
+}
+
+int thread_set_affinity(thread_t handle, uint64 mask) {
+    return (int)k_system_call(Kernel::THREAD_SET_AFFINITY_CODE, (uint64)handle, mask);
+}
+
+int thread_get_hart() {
+    return (int)k_system_call(Kernel::THREAD_GET_HART_CODE);
+}
+
 
 int sem_open(sem_t* handle, unsigned init) {
     if (handle) {
@@ -108,3 +195,9 @@ char getc() {
 int set_user_mode() {
     return (int)k_system_call(Kernel::USER_MODE_CODE);
 }
+
+
+int syscall_stats(syscall_stats_t* stats, size_t max_entries) {
+    // Returns the number of system calls that the kernel has, statistics of at most max_entries of them are written to stats (none if it is null).
+    return (int)k_system_call(Kernel::SYSCALL_STATS_CODE, (uint64)stats, (uint64)(stats ? max_entries : 0));
+}
@@ -1,15 +1,21 @@
 #include "syscall_cpp.hpp"
 
 
-Thread::Thread(void (*body)(void*), void* arg) {
-    // The thread is not started yet, we only remember on what function we want to start it, and what argument to pass it.
+Thread::Thread(void (*body)(void*), void* arg, int priority) {
+    // The thread is not started yet, we only remember on what function we want to start it, what argument to pass it, and with what priority.
     this->myHandle = nullptr;
     this->body = body;
     this->arg = arg;
+    this->priority = priority;
+    this->time_slice = TIME_SLICE_DEFAULT;
+    this->affinity = THREAD_AFFINITY_ALL;
 }
 
-Thread::Thread() {
+Thread::Thread(int priority) {
     this->myHandle = nullptr;
+    this->priority = priority;
+    this->time_slice = TIME_SLICE_DEFAULT;
+    this->affinity = THREAD_AFFINITY_ALL;
 
     // In case the user didn't pass the body* function pointer, and argument for it.
     // Then we assume that, he is creating a class that is inheriting from the Thread, and thus its run method will be called!
@@ -19,13 +25,54 @@ Thread::Thread() {
 
 int Thread::start() {
     if (!this->myHandle) {
-        // Only if thread hasn't been started (in which case the handle is null), we will start it!
-        return thread_create(&this->myHandle, this->body, this->arg);
+        // Only if thread hasn't been started (in which case the handle is null), we will start it! Its priority, time slice and affinity are given to the kernel along with it, so it never runs with the default ones.
+        thread_attr_t attr = { this->priority, this->time_slice, this->affinity };
+        int result_code = thread_create_attr(&this->myHandle, this->body, this->arg, &attr);
+        return result_code;
     }
 
     return THREAD_ALREADY_STARTED;
 }
 
+int Thread::set_priority(int priority) {
+    if (priority < THREAD_PRIORITY_HIGHEST || priority > THREAD_PRIORITY_LOWEST) {
+        return -1;
+    }
+
+    this->priority = priority;
+    if (this->myHandle) {
+        return thread_set_priority(this->myHandle, priority);
+    }
+    return 0;
+}
+
+int Thread::get_priority() {
+    // Priority of the started thread is asked from the kernel, as it may have been changed through the C API as well. Thread that has exited keeps the last priority it had here.
+    if (this->myHandle) {
+        int priority = thread_get_priority(this->myHandle);
+        if (priority >= THREAD_PRIORITY_HIGHEST) {
+            this->priority = priority;
+        }
+    }
+    return this->priority;
+}
+
+int Thread::set_time_slice(time_t ticks) {
+    this->time_slice = ticks;
+    if (this->myHandle) {
+        return thread_set_time_slice(this->myHandle, ticks);
+    }
+    return 0;
+}
+
+int Thread::set_affinity(uint64 mask) {
+    this->affinity = mask;
+    if (this->myHandle) {
+        return thread_set_affinity(this->myHandle, mask);
+    }
+    return 0;
+}
+
 void Thread::join() {
     thread_join(this->myHandle);
 }